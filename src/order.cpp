@@ -0,0 +1,135 @@
+/*
+T's Musical Tools (TMT) - A collection of esoteric modules for VCV Rack, focused on manipulating RNG and polyphonic signals.
+Copyright (C) 2024  T
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "plugin.hpp"
+#include "ports.hpp"
+#include "sort_expander.hpp"
+
+#define GRID_SNAP 10.16 // A 2hp grid in millimeters. 1 GRID_SNAP is just the right spacing for adjacent ports on the module
+#define ORDER_CABLES 4  // Extra cables each Order reorders
+
+// Expander for Sort: placed to its right, it reorders up to four more polyphonic cables the same way Sort's Sorted output is ordered,
+// and outputs that order as voltages. The sorting itself only happens once, in Sort.
+// More Orders can be chained to the right, and they all follow the same Sort.
+struct Order : Module {
+	enum ParamId {
+		PARAMS_LEN
+	};
+	enum InputId {
+		DATA1_INPUT, DATA2_INPUT, DATA3_INPUT, DATA4_INPUT,
+		INPUTS_LEN
+	};
+	enum OutputId {
+		RANK_OUTPUT,
+		PERMUTATION_OUTPUT,
+		SORTED1_OUTPUT, SORTED2_OUTPUT, SORTED3_OUTPUT, SORTED4_OUTPUT,
+		OUTPUTS_LEN
+	};
+	enum LightId {
+		LIGHTS_LEN
+	};
+
+	// Expander message buffers (static allocation to avoid DLL issues)
+	SortExpanderMessage leftMessages[2];   // To RECEIVE from Sort or the Order to our left
+
+	Order() {
+		config(PARAMS_LEN, INPUTS_LEN, OUTPUTS_LEN, LIGHTS_LEN);
+
+		configOutput(RANK_OUTPUT, "Rank");
+		outputInfos[RANK_OUTPUT]->description = "- Where each channel of Sort's Data Input ends up in its Sorted Output, 0v for first, 1v for second, and so on.\n- This is the Excel rank() of the Sort Key, counting from 0.\n- Patch it into the Sort Key of another Sort to sort a different cable in the same order.";
+
+		configOutput(PERMUTATION_OUTPUT, "Permutation");
+		outputInfos[PERMUTATION_OUTPUT]->description = "- Which channel of Sort's Data Input each channel of its Sorted Output came from, 0v for channel 1, 1v for channel 2, and so on.";
+
+		for (int i = 0; i < ORDER_CABLES; i++) {
+			configInput(DATA1_INPUT + i, "Data " + std::to_string(i + 1));
+			inputInfos[DATA1_INPUT + i]->description = "- Polyphonic input to be put in the same order as Sort's Sorted Output.\n- Mono cables are copied to every channel.";
+			configOutput(SORTED1_OUTPUT + i, "Sorted " + std::to_string(i + 1));
+			outputInfos[SORTED1_OUTPUT + i]->description = "- 'Data " + std::to_string(i + 1) + "' in the order of Sort's Sorted Output, with as many channels as Sort's Data Input.";
+		}
+
+		leftExpander.producerMessage = &leftMessages[0];
+		leftExpander.consumerMessage = &leftMessages[1];
+	}
+
+	void process(const ProcessArgs& args) override {
+		// Read message from left module (either Sort or another Order)
+		int channels = 0;
+		const int* order = nullptr;
+		bool validLeftExpander = leftExpander.module &&
+			(leftExpander.module->model == modelSort || leftExpander.module->model == modelOrder);
+		if (validLeftExpander) {
+			SortExpanderMessage* message = (SortExpanderMessage*)leftExpander.consumerMessage;
+			channels = std::min(std::max(message->channels, 0), 16);
+			order = message->order;
+
+			// Forward message to right expander (if it's another Order)
+			if (rightExpander.module && rightExpander.module->model == modelOrder) {
+				SortExpanderMessage* rightMessage = (SortExpanderMessage*)rightExpander.module->leftExpander.producerMessage;
+				*rightMessage = *message;
+				rightExpander.module->leftExpander.messageFlipRequested = true;
+			}
+		}
+
+		outputs[RANK_OUTPUT].setChannels(channels);
+		outputs[PERMUTATION_OUTPUT].setChannels(channels);
+		for (int i = 0; i < channels; i++) {
+			outputs[RANK_OUTPUT].setVoltage((float)i, order[i]);
+			outputs[PERMUTATION_OUTPUT].setVoltage((float)order[i], i);
+		}
+
+		for (int c = 0; c < ORDER_CABLES; c++) {
+			if (!inputs[DATA1_INPUT + c].isConnected()) {
+				outputs[SORTED1_OUTPUT + c].setChannels(0);
+				continue;
+			}
+			outputs[SORTED1_OUTPUT + c].setChannels(channels);
+			for (int i = 0; i < channels; i++) {
+				outputs[SORTED1_OUTPUT + c].setVoltage(inputs[DATA1_INPUT + c].getPolyVoltage(order[i]), i);
+			}
+		}
+	}
+};
+
+struct OrderWidget : ModuleWidget {
+	OrderWidget(Order* module) {
+		setModule(module);
+		setPanel(createPanel(asset::plugin(pluginInstance, "res/order.svg")));
+
+	// INPUTS --------
+		for (int i = 0; i < ORDER_CABLES; i++) {
+			addInput(createInputCentered<BrassPort>(mm2px(Vec(GRID_SNAP*1, GRID_SNAP*(1.5 + i))), module, Order::DATA1_INPUT + i));
+			// Extra cables to put in the same order as Sort's Data Input
+		}
+
+	// OUTPUTS --------
+		addOutput(createOutputCentered<BrassPortOut>(mm2px(Vec(GRID_SNAP*1, GRID_SNAP*6)), module, Order::RANK_OUTPUT));
+		// Sorted position of each channel of Sort's Data Input
+
+		addOutput(createOutputCentered<BrassPortOut>(mm2px(Vec(GRID_SNAP*1, GRID_SNAP*7)), module, Order::PERMUTATION_OUTPUT));
+		// Source channel of each channel of Sort's Sorted Output
+
+		for (int i = 0; i < ORDER_CABLES; i++) {
+			addOutput(createOutputCentered<BrassPortOut>(mm2px(Vec(GRID_SNAP*1, GRID_SNAP*(8 + i))), module, Order::SORTED1_OUTPUT + i));
+			// Each extra cable, sorted
+		}
+	}
+};
+
+
+Model* modelOrder = createModel<Order, OrderWidget>("Order");
@@ -36,4 +36,5 @@ extern Model* modelPage;
 extern Model* modelStats;
 extern Model* modelBlankt;
 extern Model* modelSort;
+extern Model* modelOrder;
 extern Model* modelSpine;
\ No newline at end of file
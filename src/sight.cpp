@@ -18,11 +18,28 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "plugin.hpp"
 #include "ports.hpp"
-#include <deque>
+#include "sight_recorder.hpp"
+#include <algorithm>
+#include <atomic>
+#include <climits>
 #include <cmath>
-#include <mutex>
-
-#define SIGHT_BUFFER_SIZE 8192
+#include <ctime>
+#include <memory>
+
+#define SIGHT_CHANNELS 16
+#define SIGHT_GROUPS (SIGHT_CHANNELS / 4)        // Channels are stored four to a float_4
+#define SIGHT_BUFFER_SIZE 8192                  // Raw samples shown on the scope
+#define SIGHT_RING_SIZE (SIGHT_BUFFER_SIZE * 2) // Power of two, with room for the audio thread to keep writing while the UI copies
+#define SIGHT_FIRST_LEVEL 5                     // Entries in the first level of history each cover 2^5 samples
+#define SIGHT_LEVELS 19                         // Each level's entries cover twice the samples of the one below
+#define SIGHT_LEVEL_SIZE 64                     // Entries kept per level, the newest half of which get drawn
+#define SIGHT_LEVEL_SHOWN (SIGHT_LEVEL_SIZE / 2)
+#define SIGHT_MIN_OCTAVES 13                    // History shown is 2^octaves samples, from SIGHT_BUFFER_SIZE...
+#define SIGHT_MAX_OCTAVES 28                    // ...up to what the top level covers: SIGHT_LEVEL_SHOWN << (SIGHT_FIRST_LEVEL + SIGHT_LEVELS - 1)
+#define SIGHT_FFT_SIZE 4096                     // Newest samples the spectrum is taken over
+#define SIGHT_SPECTRUM_FLOOR -100.f             // dB at the bottom of the spectrum, where 0dB at the top is a 10V sine
+#define SIGHT_SWEEP_SIZE 2048                   // Samples across one persistence sweep
+#define SIGHT_GLOW_DECAY 0.92f                  // How much of its brightness each persistence pixel keeps per frame
 
 struct Timer {
 	// There's probably something in dsp which could handle this better,
@@ -50,9 +67,124 @@ struct Timer {
 	}
 };
 
+// A ring the audio thread pushes into and never waits on. The UI copies the newest entries out with snapshot().
+// Each entry is a float_4 for every group of four channels. A group only gets its storage once a cable
+// has brought that many channels (see grow()), so a mono Sight pays for four lanes but never for sixteen.
+template <int SIZE>
+struct SightRing {
+	std::unique_ptr<simd::float_4[]> groupSlots[SIGHT_GROUPS]; // Per group, SIZE entries
+	std::atomic<int> groupsAllocated{0};
+	std::atomic<uint32_t> writeCount{0}; // Entries written so far, wrapping; the next slot is writeCount & (SIZE - 1)
+
+	// Gives the first groups groups their storage, zeroed. It allocates, so never on the audio thread.
+	// Groups are never taken away again, so the audio thread can't be left writing into freed memory.
+	void grow(int groups) {
+		int allocated = groupsAllocated.load(std::memory_order_relaxed);
+		if (groups <= allocated) return;
+		for (int g = allocated; g < groups; g++) {
+			groupSlots[g].reset(new simd::float_4[SIZE]);
+			for (int i = 0; i < SIZE; i++) {
+				groupSlots[g][i] = 0.f;
+			}
+		}
+		groupsAllocated.store(groups, std::memory_order_release);
+	}
+
+	// Writes the first groups groups of values; any that don't have storage yet are skipped
+	void push(const simd::float_4* values, int groups) {
+		groups = std::min(groups, groupsAllocated.load(std::memory_order_acquire));
+		uint32_t count = writeCount.load(std::memory_order_relaxed);
+		int slot = count & (SIZE - 1);
+		for (int g = 0; g < groups; g++) {
+			groupSlots[g][slot] = values[g];
+		}
+		writeCount.store(count + 1, std::memory_order_release);
+	}
+
+	// Copies the first groups groups of the newest count entries into buffer, newest first, packed together.
+	// count can be at most half of SIZE.
+	// Works like a seqlock: if the audio thread wrote far enough during the copy to reach the entries
+	// being copied, the copy is torn and gets retried. The spare half of the ring makes that very unlikely.
+	bool snapshot(simd::float_4* buffer, int count, int groups) const {
+		for (int attempt = 0; attempt < 4; attempt++) {
+			if (copy(buffer, writeCount.load(std::memory_order_acquire), count, groups)) return true;
+		}
+		return false;
+	}
+
+	// Copies the count entries written before the end'th, newest first, the same way as snapshot().
+	// Groups without storage yet read as zeros.
+	// Returns false if the audio thread has written over any of them, during the copy or before it.
+	bool copy(simd::float_4* buffer, uint32_t end, int count, int groups) const {
+		int allocated = groupsAllocated.load(std::memory_order_acquire);
+		for (int i = 0; i < count; i++) {
+			int slot = (end - 1 - i) & (SIZE - 1);
+			for (int g = 0; g < groups; g++) {
+				buffer[i * groups + g] = (g < allocated) ? groupSlots[g][slot] : simd::float_4(0.f);
+			}
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint32_t written = writeCount.load(std::memory_order_relaxed) - end;
+		return written <= (uint32_t)(SIZE - count);
+	}
+};
+
+// One level of the history cascade: the lowest and highest voltage of each span, for every channel.
+// Unlike the raw ring, each channel keeps its own plain floats, so a mono input holds one channel of history, not four.
+// Spans only arrive every 32 samples or more, so taking the lanes apart on the way in costs next to nothing.
+// Read the same way as SightRing, and handed to the UI as a low then a high float_4 per group, like the cascade builds them.
+struct SightLevel {
+	std::unique_ptr<float[]> channelSpans[SIGHT_CHANNELS]; // Per channel, SIGHT_LEVEL_SIZE lows and highs, interleaved
+	std::atomic<int> channelsAllocated{0};
+	std::atomic<uint32_t> writeCount{0};
+
+	// Gives the first channels channels their storage, zeroed. UI thread only, and never taken away, like SightRing::grow().
+	void grow(int channels) {
+		int allocated = channelsAllocated.load(std::memory_order_relaxed);
+		if (channels <= allocated) return;
+		for (int c = allocated; c < channels; c++) {
+			channelSpans[c].reset(new float[SIGHT_LEVEL_SIZE * 2]());
+		}
+		channelsAllocated.store(channels, std::memory_order_release);
+	}
+
+	// Writes one span, a low then a high float_4 per group, for the first channels channels that have storage
+	void push(const simd::float_4* span, int channels) {
+		channels = std::min(channels, channelsAllocated.load(std::memory_order_acquire));
+		uint32_t count = writeCount.load(std::memory_order_relaxed);
+		int slot = (count & (SIGHT_LEVEL_SIZE - 1)) * 2;
+		for (int c = 0; c < channels; c++) {
+			channelSpans[c][slot] = span[2 * (c / 4)][c % 4];
+			channelSpans[c][slot + 1] = span[2 * (c / 4) + 1][c % 4];
+		}
+		writeCount.store(count + 1, std::memory_order_release);
+	}
+
+	// Copies the newest count spans of the first groups groups into buffer, newest first. count can be at most half of SIGHT_LEVEL_SIZE.
+	bool snapshot(simd::float_4* buffer, int count, int groups) const {
+		for (int attempt = 0; attempt < 4; attempt++) {
+			uint32_t end = writeCount.load(std::memory_order_acquire);
+			int allocated = channelsAllocated.load(std::memory_order_acquire);
+			for (int i = 0; i < count; i++) {
+				int slot = ((end - 1 - i) & (SIGHT_LEVEL_SIZE - 1)) * 2;
+				for (int c = 0; c < groups * 4; c++) {
+					bool stored = c < allocated;
+					buffer[(i * groups + c / 4) * 2][c % 4] = stored ? channelSpans[c][slot] : 0.f;
+					buffer[(i * groups + c / 4) * 2 + 1][c % 4] = stored ? channelSpans[c][slot + 1] : 0.f;
+				}
+			}
+			std::atomic_thread_fence(std::memory_order_acquire);
+			uint32_t written = writeCount.load(std::memory_order_relaxed) - end;
+			if (written <= (uint32_t)(SIGHT_LEVEL_SIZE - count)) return true;
+		}
+		return false;
+	}
+};
+
 struct Sight : Module {
 	enum ParamId {
 		TOGGLE_SWITCH,
+		RECORD_SWITCH,
 		PARAMS_LEN
 	};
 	enum InputId {
@@ -65,31 +197,254 @@ struct Sight : Module {
 	enum LightId {
 		LIGHTS_LEN
 	};
+	enum DisplayMode {
+		DISPLAY_TRACE,
+		DISPLAY_SPECTRUM,
+		DISPLAY_PERSISTENCE
+	};
 
-	std::deque<float> voltageBuffer;
-    std::deque<float> voltageBufferCopy; // Copy of voltageBuffer for safe access
-    const int bufferSize = SIGHT_BUFFER_SIZE;
-    bool bufferNeedsUpdate = true; // Flag to indicate if the buffer needs update
+	// Raw samples, plus a cascade of levels that each keep half as many spans as the level below per sample,
+	// so the scope can reach minutes or hours back without storing every sample. See cascade().
+	// Storage comes as the input needs it (see growStorage()). Raw samples are stored a float_4 per group of four
+	// channels, so the audio thread writes each group in one go, at 256 KB per group: a mono or five-channel input
+	// pays for four or eight lanes, of which it only uses one or five. That's four times what a mono input needs,
+	// traded for one store per group on every sample. History is kept per channel, under 10 KB each.
+	SightRing<SIGHT_RING_SIZE> ring;
+	SightLevel levels[SIGHT_LEVELS];
+	simd::float_4 pending[SIGHT_LEVELS][SIGHT_GROUPS * 2]; // The span each level is building up
+	int pendingCount[SIGHT_LEVELS] = {};
+	std::atomic<int> channels{1}; // Channels being captured, for the scope
+	int historyOctaves = SIGHT_MIN_OCTAVES; // The scope shows the last 2^historyOctaves samples
+	int displayMode = DISPLAY_TRACE; // Only the scope looks at this, the audio thread captures the same either way
+
+	// Recording to a file in the patch storage directory; see startRecording()
+	// The UI thread owns every recorder, and tells the audio thread which one to feed with wantedRecorder,
+	// counting every change in recorderChanges. The audio thread switches over in serviceRecorder(), retiring the one
+	// it fed before, and counts the changes it has taken in with recorderChangesSeen. Neither thread waits on the other:
+	// a recorder that's been switched away from waits in retiring until the audio thread has let go of it and its writer
+	// has finished the file, and updateRecording() frees it then.
+	struct RetiringRecorder {
+		std::unique_ptr<SightRecorder> recorder;
+		uint32_t change; // The audio thread has let go once it has seen this many changes
+	};
+	std::unique_ptr<SightRecorder> recorder;
+	std::vector<RetiringRecorder> retiring;
+	std::atomic<SightRecorder*> wantedRecorder{nullptr};
+	std::atomic<uint32_t> recorderChanges{0};
+	std::atomic<uint32_t> recorderChangesSeen{0};
+	SightRecorder* capturingRecorder = nullptr; // Audio thread only
+	int recordFormat = SightRecorder::WAV;
+	std::string recordingName;
 	Timer timeSinceUpdate;
 
 	Sight() {
 		config(PARAMS_LEN, INPUTS_LEN, OUTPUTS_LEN, LIGHTS_LEN);
 		configParam(TOGGLE_SWITCH, 0.f, 1.f, 0.f, "Alt Mode: Process at audio rate (CPU heavy)");
+		configSwitch(RECORD_SWITCH, 0.f, 1.f, 0.f, "Record to file", {"Off", "On"});
+		paramQuantities[RECORD_SWITCH]->randomizeEnabled = false;
 		configInput(VOLTAGE_INPUT, "Voltage");
 
-        // Initialize both buffers with zeros
-        voltageBuffer.resize(bufferSize, 0.f);
-        voltageBufferCopy.resize(bufferSize, 0.f);
+		for (int level = 0; level < SIGHT_LEVELS; level++) {
+			for (int j = 0; j < SIGHT_GROUPS * 2; j++) {
+				pending[level][j] = 0.f;
+			}
+		}
+		growStorage(1);
 	}
 
-    void advanceBuffer(float inputVoltage) {
-        voltageBuffer.pop_back();
-        voltageBuffer.push_front(inputVoltage);
-        bufferNeedsUpdate = true; // Mark buffer as needing update
-    }
+	// Makes room for the first channelCount channels in the ring and every level.
+	// Called from the UI thread as the input's channels go up; the audio thread only captures the channels that have room.
+	void growStorage(int channelCount) {
+		ring.grow((channelCount + 3) / 4);
+		for (int level = 0; level < SIGHT_LEVELS; level++) {
+			levels[level].grow(channelCount);
+		}
+	}
+
+	// The engine has stopped processing Sight by now, so the recorders can be finished right here
+	~Sight() {
+		recorder.reset();
+		retiring.clear();
+	}
+
+	// Starts streaming every captured frame to a new file in the patch storage directory,
+	// at the rate Sight is sampling at now, and with as many channels as it's capturing now. Called from the UI thread.
+	bool startRecording() {
+		float sampleRate = APP->engine->getSampleRate();
+		if (params[TOGGLE_SWITCH].getValue() < 0.5f) {
+			// The 1kHz timer fires on the first sample at least a millisecond after the last
+			sampleRate /= std::ceil(sampleRate * 0.001f - 1e-3f);
+		}
+		char stamp[32];
+		std::time_t now = std::time(nullptr);
+		std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", std::localtime(&now));
+		// A recording that carries on in a new file can start within the same second as the last one
+		const char* extension = (recordFormat == SightRecorder::CSV) ? ".csv" : ".wav";
+		std::string name = std::string("sight-") + stamp + extension;
+		std::string path = system::join(createPatchStorageDirectory(), name);
+		for (int part = 2; system::exists(path); part++) {
+			name = std::string("sight-") + stamp + "-" + std::to_string(part) + extension;
+			path = system::join(createPatchStorageDirectory(), name);
+		}
+
+		std::unique_ptr<SightRecorder> newRecorder(new SightRecorder(path,
+			(SightRecorder::Format)recordFormat, channels.load(), sampleRate));
+		if (!newRecorder->start()) {
+			WARN("Sight could not open %s for recording", path.c_str());
+			return false;
+		}
+		switchRecorder(std::move(newRecorder));
+		recordingName = name;
+		return true;
+	}
+
+	// Stops feeding the file; updateRecording() finishes it. Called from the UI thread.
+	void stopRecording() {
+		if (!recorder) return;
+		switchRecorder(nullptr);
+	}
+
+	// Points the audio thread at next, and sets the recorder it was fed before aside until it's let go of
+	void switchRecorder(std::unique_ptr<SightRecorder> next) {
+		wantedRecorder.store(next.get(), std::memory_order_release);
+		uint32_t change = recorderChanges.load(std::memory_order_relaxed) + 1;
+		recorderChanges.store(change, std::memory_order_release);
+		if (recorder) {
+			RetiringRecorder old;
+			old.recorder = std::move(recorder);
+			old.change = change;
+			retiring.push_back(std::move(old));
+		}
+		recorder = std::move(next);
+	}
+
+	// Starts or stops recording to follow the record switch, carries a recording on in a new file when the input's
+	// channel count changes, since a file's channel count is fixed, and finishes and frees the recorders the audio thread
+	// has let go of. Called from the UI thread every frame.
+	void updateRecording() {
+		bool wanted = params[RECORD_SWITCH].getValue() >= 0.5f;
+		if (wanted && (!recorder || recorder->channels != channels.load(std::memory_order_relaxed))) {
+			if (!startRecording()) {
+				// Flip the switch back rather than trying again every frame
+				params[RECORD_SWITCH].setValue(0.f);
+				stopRecording();
+			}
+		} else if (!wanted) {
+			stopRecording();
+		}
+
+		uint32_t seen = recorderChangesSeen.load(std::memory_order_acquire);
+		for (size_t i = 0; i < retiring.size();) {
+			SightRecorder* old = retiring[i].recorder.get();
+			if ((int32_t)(seen - retiring[i].change) >= 0) {
+				old->requestStop();
+				if (old->finished()) {
+					retiring.erase(retiring.begin() + i);
+					continue;
+				}
+			}
+			i++;
+		}
+	}
+
+	// Takes up the recorder the UI thread wants fed, if that's changed. Audio thread only, on every sample.
+	void serviceRecorder() {
+		uint32_t changes = recorderChanges.load(std::memory_order_acquire);
+		if (changes == recorderChangesSeen.load(std::memory_order_relaxed)) return;
+		SightRecorder* wanted = wantedRecorder.load(std::memory_order_acquire);
+		if (wanted != capturingRecorder) {
+			if (capturingRecorder) {
+				capturingRecorder->retire();
+			}
+			capturingRecorder = wanted;
+		}
+		recorderChangesSeen.store(changes, std::memory_order_release);
+	}
+
+	// The first level gathers 2^SIGHT_FIRST_LEVEL samples per span, and every level above joins two spans
+	// of the level below. Half as much work goes to each level up, so it averages out to O(1) per sample.
+	void cascade(const simd::float_4* voltages, int channelCount) {
+		int groups = (channelCount + 3) / 4;
+		simd::float_4* first = pending[0];
+		for (int g = 0; g < groups; g++) {
+			if (pendingCount[0] == 0) {
+				first[2 * g] = first[2 * g + 1] = voltages[g];
+			} else {
+				first[2 * g] = simd::fmin(first[2 * g], voltages[g]);
+				first[2 * g + 1] = simd::fmax(first[2 * g + 1], voltages[g]);
+			}
+		}
+		if (++pendingCount[0] < (1 << SIGHT_FIRST_LEVEL)) return;
+		pendingCount[0] = 0;
+
+		simd::float_4 span[SIGHT_GROUPS * 2];
+		for (int j = 0; j < groups * 2; j++) {
+			span[j] = first[j];
+		}
+		for (int level = 0; level < SIGHT_LEVELS; level++) {
+			levels[level].push(span, channelCount);
+			if (level + 1 == SIGHT_LEVELS) break;
+			simd::float_4* above = pending[level + 1];
+			if (pendingCount[level + 1] == 0) {
+				for (int j = 0; j < groups * 2; j++) {
+					above[j] = span[j];
+				}
+				pendingCount[level + 1] = 1;
+				break;
+			}
+			for (int g = 0; g < groups; g++) {
+				span[2 * g] = simd::fmin(above[2 * g], span[2 * g]);
+				span[2 * g + 1] = simd::fmax(above[2 * g + 1], span[2 * g + 1]);
+			}
+			pendingCount[level + 1] = 0;
+		}
+	}
+
+	// One float_4 per four channels into the ring, and on into the cascade
+	void advanceBuffer(int channelCount) {
+		int groups = (channelCount + 3) / 4;
+		simd::float_4 voltages[SIGHT_GROUPS];
+		for (int g = 0; g < groups; g++) {
+			voltages[g] = inputs[VOLTAGE_INPUT].getVoltageSimd<simd::float_4>(g * 4);
+		}
+		ring.push(voltages, groups);
+		cascade(voltages, channelCount);
+		channels.store(channelCount, std::memory_order_relaxed);
+
+		// Until the UI thread switches to a file with the new channel count, frames that won't fit are left out
+		if (capturingRecorder && capturingRecorder->channels == channelCount) {
+			capturingRecorder->push(inputs[VOLTAGE_INPUT].getVoltages());
+		}
+	}
+
+	json_t* dataToJson() override {
+		json_t* rootJ = json_object();
+		json_object_set_new(rootJ, "historyOctaves", json_integer(historyOctaves));
+		json_object_set_new(rootJ, "displayMode", json_integer(displayMode));
+		json_object_set_new(rootJ, "recordFormat", json_integer(recordFormat));
+		return rootJ;
+	}
+
+	void dataFromJson(json_t* rootJ) override {
+		json_t* historyOctavesJ = json_object_get(rootJ, "historyOctaves");
+		if (historyOctavesJ) {
+			historyOctaves = clamp((int)json_integer_value(historyOctavesJ), SIGHT_MIN_OCTAVES, SIGHT_MAX_OCTAVES);
+		}
+		json_t* displayModeJ = json_object_get(rootJ, "displayMode");
+		if (displayModeJ) {
+			displayMode = clamp((int)json_integer_value(displayModeJ), (int)DISPLAY_TRACE, (int)DISPLAY_PERSISTENCE);
+		}
+		json_t* recordFormatJ = json_object_get(rootJ, "recordFormat");
+		if (recordFormatJ) {
+			recordFormat = clamp((int)json_integer_value(recordFormatJ), (int)SightRecorder::WAV, (int)SightRecorder::CSV);
+		}
+		// A patch opens with recording off, rather than starting a new file by itself
+		params[RECORD_SWITCH].setValue(0.f);
+	}
 
 	void process(const ProcessArgs& args) override {
 		timeSinceUpdate.update(args.sampleTime); // Advance the timer
+		serviceRecorder(); // Even with nothing plugged in, so a recording can always be let go of
 
 		if (!inputs[VOLTAGE_INPUT].isConnected()) {
 			return; // Break early if there's no input
@@ -102,47 +457,236 @@ struct Sight : Module {
 
 		timeSinceUpdate.reset(); // Reset the timer, since we're about to process
 
-		advanceBuffer(inputs[VOLTAGE_INPUT].getVoltage());
-
-        // Copy the voltageBuffer for safe access by SightScope widget
-        if (bufferNeedsUpdate) {
-            std::lock_guard<std::mutex> lock(bufferMutex);
-            voltageBufferCopy = voltageBuffer;
-            bufferNeedsUpdate = false;
-        }
+		advanceBuffer(std::min(std::max(inputs[VOLTAGE_INPUT].getChannels(), 1), SIGHT_CHANNELS));
 	}
 
-    // Mutex for thread safety
-    std::mutex bufferMutex;
+	void processBypass(const ProcessArgs& args) override {
+		serviceRecorder();
+		Module::processBypass(args);
+	}
 };
 
 struct SightScope : LightWidget {
     Sight* module;
     int bufferSize = SIGHT_BUFFER_SIZE;
-    std::deque<float> voltageBuffer;
+    int groups = 1; // Groups of four channels in the buffers
+    std::vector<simd::float_4> voltageBuffer; // Newest first, groups per sample
+    std::vector<simd::float_4> snapshotBuffer; // Copied into, then swapped with voltageBuffer
+    std::vector<simd::float_4> levelBuffers[SIGHT_LEVELS]; // Newest first, a low and a high per group; only filled for levels the columns use
+    std::vector<simd::float_4> levelSnapshot;
+    std::vector<simd::float_4> columnLows; // Each column's range, groups per column
+    std::vector<simd::float_4> columnHighs;
     std::vector<float> scalingFactors; // Store precalculated scaling factors
 	std::vector<float> precomputedPositions; // Store precalculated scaled positions
+	float positionsWidth = 0.f; // Width the positions were computed for
+	int positionsOctaves = SIGHT_MIN_OCTAVES; // History length they were computed for
+	int levelsUsed = 0;
+
+	// A run of history drawn at one x position
+	struct TraceColumn {
+		int level;         // -1 for raw samples, otherwise which level of the module's cascade
+		int start;         // Newest sample or span in the column
+		int end;
+		float x;
+		int thicknessStep; // Stroke width in quarter pixels
+	};
+	std::vector<TraceColumn> columns;
+	std::vector<float> lowYs; // One channel's columns, ready to stroke
+	std::vector<float> highYs;
 	bool dirty = true;
 
+	// Spectrum mode, all worked out here on the UI thread from the same ring the trace reads
+	dsp::RealFFT fft{SIGHT_FFT_SIZE};
+	alignas(16) float fftInput[SIGHT_FFT_SIZE];
+	alignas(16) float fftOutput[SIGHT_FFT_SIZE * 2]; // DC, Nyquist, then each bin's real and imaginary parts
+	float fftWindow[SIGHT_FFT_SIZE];
+	float fftWindowSum = 0.f;
+	std::vector<simd::float_4> spectrumBuffer; // Newest first, groups per sample
+	std::vector<float> spectrumPositions; // x of each bin from 1 up, on a log frequency scale
+	std::vector<float> binYs;
+	std::vector<TraceColumn> spectrumColumns;
+
+	// Persistence mode: only the samples that arrived since the last frame get swept into an intensity image,
+	// which fades a little every frame and is drawn as a single textured rectangle
+	std::vector<float> glow;             // Brightness of each pixel, 0 to 1
+	std::vector<uint8_t> glowChannels;   // Which channel last lit each pixel, for its colour
+	std::vector<uint8_t> glowPixels;     // RGBA for the image
+	std::vector<simd::float_4> glowBuffer; // The new samples, newest first
+	int glowWidth = 0, glowHeight = 0;
+	int glowImage = -1;                  // NanoVG image handle
+	bool glowImageSized = false;         // Whether the image handle matches glowWidth and glowHeight
+	uint32_t glowCount = 0;              // The module's write count when the image last caught up
+	bool glowCounting = false;           // Whether glowCount means anything yet
+	int sweepPosition = -1;              // Samples into the current sweep, or -1 while waiting for a trigger
+	int sweepWait = 0;                   // Samples spent waiting, so it can free-run without a trigger
+	int sweepLastY[SIGHT_CHANNELS];      // Where each channel's line was last sample, or -1 at the start of a sweep
+	dsp::SchmittTrigger sweepTrigger;
+
     SightScope(Sight* module) {
         this->module = module;
-        voltageBuffer.resize(bufferSize, 0.f); // Match module
-        bufferSize = voltageBuffer.size(); // Match module
+        voltageBuffer.resize(bufferSize * SIGHT_GROUPS, 0.f); // Match module
+        snapshotBuffer.resize(bufferSize * SIGHT_GROUPS, 0.f);
+        levelSnapshot.resize(SIGHT_LEVEL_SHOWN * SIGHT_GROUPS * 2, 0.f);
+        spectrumBuffer.resize(SIGHT_FFT_SIZE * SIGHT_GROUPS, 0.f);
+        binYs.resize(SIGHT_FFT_SIZE / 2);
+
+        // Hann window
+        for (int i = 0; i < SIGHT_FFT_SIZE; i++) {
+            fftWindow[i] = 0.5f - 0.5f * std::cos(2.f * M_PI * i / (SIGHT_FFT_SIZE - 1));
+            fftWindowSum += fftWindow[i];
+        }
 		dirty = true;
     }
 
+    ~SightScope() {
+        if (glowImage >= 0 && APP->window) nvgDeleteImage(APP->window->vg, glowImage);
+    }
+
+    void onContextDestroy(const ContextDestroyEvent& e) override {
+        glowImage = -1; // Gone with the context
+        glowImageSized = false;
+        LightWidget::onContextDestroy(e);
+    }
+
+	static int thicknessStep(float scalingFactor) {
+		// Quarter pixel steps, so neighbouring columns can share a path
+		return std::max(1, (int)std::round(12.f * (1.f - scalingFactor)));
+	}
+
+	// Groups items at steadily moving x positions into columns: one per item where they're spread out,
+	// one per pixel where many of them land together. Thickness is left for the caller.
+	static void groupColumns(const std::vector<float>& positions, std::vector<TraceColumn>& columns) {
+		columns.clear();
+		int count = (int)positions.size();
+		int pixel = INT_MAX;
+		for (int i = 0; i < count; ++i) {
+			int itemPixel = (int)std::floor(positions[i]);
+			bool packed = i + 1 < count && (int)std::floor(positions[i + 1]) == itemPixel;
+			if (itemPixel == pixel) continue; // Still in the current pixel's column
+			if (!columns.empty()) columns.back().end = i;
+			TraceColumn column;
+			column.level = -1;
+			column.start = i;
+			column.x = packed ? itemPixel + 0.5f : positions[i];
+			column.thicknessStep = 0;
+			columns.push_back(column);
+			pixel = itemPixel;
+		}
+		columns.back().end = count;
+	}
+
 	void precomputePositions() {
+		float octaves = positionsOctaves;
 		scalingFactors.resize(bufferSize);
 		precomputedPositions.resize(bufferSize);
 		for (int i = 0; i < bufferSize; ++i) {
-			scalingFactors[i] = std::log2(i + 1) / std::log2(bufferSize);
+			scalingFactors[i] = std::log2(i + 1) / octaves;
 			precomputedPositions[i] = (box.size.x - scalingFactors[i] * box.size.x) * 1.5f;
 		}
+
+		// Samples are spread out on the right and packed together on the left
+		groupColumns(precomputedPositions, columns);
+		for (TraceColumn& column : columns) {
+			column.thicknessStep = thicknessStep(scalingFactors[column.start]);
+		}
+
+		// History older than the raw samples comes from the cascade, a pixel at a time,
+		// from the finest level that still reaches back to the far side of the pixel
+		levelsUsed = 0;
+		double span = std::exp2(octaves);
+		double fullWidth = box.size.x * 1.5;
+		for (int p = (int)std::floor(precomputedPositions[bufferSize - 1]); p >= 0; p--) {
+			double newest = std::ceil(std::exp2(octaves * (1.0 - (p + 1) / fullWidth)) - 1.0);
+			double oldest = std::min(span, std::exp2(octaves * (1.0 - p / fullWidth)) - 1.0);
+			newest = std::max(newest, (double)bufferSize);
+			if (oldest <= newest) continue;
+			int level = 0;
+			while (level + 1 < SIGHT_LEVELS && ((double)SIGHT_LEVEL_SHOWN * std::exp2(SIGHT_FIRST_LEVEL + level)) < oldest) level++;
+			double entrySamples = std::exp2(SIGHT_FIRST_LEVEL + level);
+			TraceColumn column;
+			column.level = level;
+			column.start = std::min((int)(newest / entrySamples), SIGHT_LEVEL_SHOWN - 1);
+			column.end = std::max(column.start + 1, std::min((int)(oldest / entrySamples) + 1, SIGHT_LEVEL_SHOWN));
+			column.x = p + 0.5f;
+			column.thicknessStep = thicknessStep(std::log2(newest + 1) / octaves);
+			columns.push_back(column);
+			levelsUsed = std::max(levelsUsed, level + 1);
+		}
+		for (int level = 0; level < levelsUsed; level++) {
+			levelBuffers[level].assign(SIGHT_LEVEL_SHOWN * SIGHT_GROUPS * 2, 0.f);
+		}
+
+		// Spectrum bins from the lowest above DC up to just under Nyquist, low on the left
+		int bins = SIGHT_FFT_SIZE / 2;
+		spectrumPositions.resize(bins - 1);
+		for (int k = 1; k < bins; k++) {
+			spectrumPositions[k - 1] = box.size.x * std::log2((float)k) / std::log2((float)(bins - 1));
+		}
+		groupColumns(spectrumPositions, spectrumColumns);
+		for (TraceColumn& column : spectrumColumns) {
+			column.thicknessStep = 6;
+		}
 		dirty = false;
 	}
 
-	void step() override {
+	// Every column's lowest and highest voltage, for four channels at a time
+	void reduceColumns() {
+		columnLows.resize(columns.size() * groups);
+		columnHighs.resize(columns.size() * groups);
+		for (size_t c = 0; c < columns.size(); c++) {
+			const TraceColumn& column = columns[c];
+			simd::float_4* lows = &columnLows[c * groups];
+			simd::float_4* highs = &columnHighs[c * groups];
+			if (column.level < 0) {
+				for (int g = 0; g < groups; g++) {
+					lows[g] = highs[g] = voltageBuffer[column.start * groups + g];
+				}
+				for (int i = column.start + 1; i < column.end; i++) {
+					const simd::float_4* sample = &voltageBuffer[i * groups];
+					for (int g = 0; g < groups; g++) {
+						lows[g] = simd::fmin(lows[g], sample[g]);
+						highs[g] = simd::fmax(highs[g], sample[g]);
+					}
+				}
+			} else {
+				const std::vector<simd::float_4>& spans = levelBuffers[column.level];
+				for (int g = 0; g < groups; g++) {
+					lows[g] = spans[column.start * groups * 2 + 2 * g];
+					highs[g] = spans[column.start * groups * 2 + 2 * g + 1];
+				}
+				for (int i = column.start + 1; i < column.end; i++) {
+					const simd::float_4* span = &spans[i * groups * 2];
+					for (int g = 0; g < groups; g++) {
+						lows[g] = simd::fmin(lows[g], span[2 * g]);
+						highs[g] = simd::fmax(highs[g], span[2 * g + 1]);
+					}
+				}
+			}
+		}
+	}
 
+	// Channel 1 is the usual gold, the rest step around the colour wheel from there
+	static NVGcolor channelColor(int channel) {
+		if (channel == 0) return nvgRGBA(254, 201, 1, 255);
+		return nvgHSL(std::fmod(0.13f + channel * 0.618034f, 1.f), 0.99f, 0.55f);
+	}
+
+	float voltageToY(float voltage) {
+		return box.size.y - rescale(voltage, -10.f, 10.f, 0.f, box.size.y);
+	}
+
+	void step() override {
+		if (box.size.x != positionsWidth) {
+			positionsWidth = box.size.x;
+			dirty = true;
+		}
+		if (module && module->historyOctaves != positionsOctaves) {
+			positionsOctaves = module->historyOctaves;
+			dirty = true;
+		}
+		if (module) {
+			module->growStorage(module->channels.load(std::memory_order_relaxed));
+		}
 	}
 
 
@@ -153,62 +697,214 @@ struct SightScope : LightWidget {
 
 		if (dirty) precomputePositions();
 
-        // Safely access the voltageBufferCopy from Sight module
-        {
-            std::lock_guard<std::mutex> lock(module->bufferMutex);
-            voltageBuffer = module->voltageBufferCopy;
+        nvgScissor(args.vg, args.clipBox.pos.x, args.clipBox.pos.y, args.clipBox.size.x, args.clipBox.size.y);
+        nvgLineCap(args.vg, NVG_ROUND);
+        nvgLineJoin(args.vg, NVG_ROUND);
+
+        int channelCount = module->channels.load(std::memory_order_relaxed);
+        groups = (channelCount + 3) / 4;
+        if (module->displayMode == Sight::DISPLAY_SPECTRUM) {
+            drawSpectrum(args.vg, channelCount);
+        } else if (module->displayMode == Sight::DISPLAY_PERSISTENCE) {
+            drawPersistence(args.vg, channelCount);
+        } else {
+            drawTrace(args.vg, channelCount);
         }
 
-		nvgScissor(args.vg, args.clipBox.pos.x, args.clipBox.pos.y, args.clipBox.size.x, args.clipBox.size.y);
-
+        nvgResetScissor(args.vg);
 
+        // Start afresh next time persistence is shown, rather than sweeping through everything since
+        if (module->displayMode != Sight::DISPLAY_PERSISTENCE) {
+            glowCounting = false;
+        }
+	}
 
-		// Draw the input voltages in the buffer
-		for (int i = 0; i < bufferSize - 1; i++) {
-			// Calculate the thickness for this segment and the next segment
-			float thicknessStart = 3.f * (1.f - scalingFactors[i]);
-			float thicknessEnd = 3.f * (1.f - scalingFactors[i + 1]);
-			float position1 = precomputedPositions[i];
-			float position2 = precomputedPositions[i + 1];
-
-			// Begin a new path for each segment
-			nvgBeginPath(args.vg);
-			nvgMoveTo(args.vg, position1, box.size.y - rescale(voltageBuffer[i], -10.f, 10.f, 0.f, box.size.y));
-			nvgLineTo(args.vg, position2, box.size.y - rescale(voltageBuffer[i + 1], -10.f, 10.f, 0.f, box.size.y));
+	void drawTrace(NVGcontext* vg, int channelCount) {
+        // Copy the newest history out of the module; if a copy was torn, keep drawing the last good one.
+        // Only the groups of channels in use get copied.
+        if (module->ring.snapshot(snapshotBuffer.data(), bufferSize, groups)) {
+            voltageBuffer.swap(snapshotBuffer);
+        }
+        for (int level = 0; level < levelsUsed; level++) {
+            if (module->levels[level].snapshot(levelSnapshot.data(), SIGHT_LEVEL_SHOWN, groups)) {
+                levelBuffers[level].swap(levelSnapshot);
+            }
+        }
+        reduceColumns();
+
+		lowYs.resize(columns.size());
+		highYs.resize(columns.size());
+		// Last channel first, so channel 1 ends up on top
+		for (int channel = channelCount - 1; channel >= 0; channel--) {
+			int group = channel / 4;
+			int lane = channel % 4;
+			for (size_t c = 0; c < columns.size(); c++) {
+				lowYs[c] = voltageToY(columnLows[c * groups + group][lane]);
+				highYs[c] = voltageToY(columnHighs[c * groups + group][lane]);
+			}
+			nvgStrokeColor(vg, channelColor(channel));
+			strokeColumns(vg, columns, voltageToY(voltageBuffer[group][lane]));
+		}
+	}
 
-			// Set the line thickness for this segment
-			nvgStrokeWidth(args.vg, thicknessStart);
+	// A windowed FFT of the newest SIGHT_FFT_SIZE samples of each channel, as magnitude over log frequency.
+	// The bins get the same per-pixel columns as the trace, so the busy top end is still only a few strokes.
+	void drawSpectrum(NVGcontext* vg, int channelCount) {
+		// A torn copy would only smudge one frame of the spectrum, so it isn't worth keeping the last good one
+		module->ring.snapshot(spectrumBuffer.data(), SIGHT_FFT_SIZE, groups);
+
+		int bins = SIGHT_FFT_SIZE / 2;
+		float scale = 2.f / (fftWindowSum * 10.f); // Magnitude as a fraction of a 10V sine
+		lowYs.resize(spectrumColumns.size());
+		highYs.resize(spectrumColumns.size());
+		for (int channel = channelCount - 1; channel >= 0; channel--) {
+			int group = channel / 4;
+			int lane = channel % 4;
+			// Oldest sample first
+			for (int i = 0; i < SIGHT_FFT_SIZE; i++) {
+				fftInput[i] = spectrumBuffer[(SIGHT_FFT_SIZE - 1 - i) * groups + group][lane] * fftWindow[i];
+			}
+			fft.rfft(fftInput, fftOutput);
+			for (int k = 1; k < bins; k++) {
+				float magnitude = std::hypot(fftOutput[2 * k], fftOutput[2 * k + 1]) * scale;
+				float decibels = 20.f * std::log10(std::max(magnitude, 1e-6f));
+				binYs[k - 1] = rescale(clamp(decibels, SIGHT_SPECTRUM_FLOOR, 0.f), SIGHT_SPECTRUM_FLOOR, 0.f, box.size.y, 0.f);
+			}
+			for (size_t c = 0; c < spectrumColumns.size(); c++) {
+				const TraceColumn& column = spectrumColumns[c];
+				// Louder is higher up, so smaller y
+				lowYs[c] = *std::max_element(&binYs[column.start], &binYs[column.end]);
+				highYs[c] = *std::min_element(&binYs[column.start], &binYs[column.end]);
+			}
+			nvgStrokeColor(vg, channelColor(channel));
+			strokeColumns(vg, spectrumColumns, lowYs[0]);
+		}
+	}
 
-			// Stroke the segment
-			nvgStrokeColor(args.vg, nvgRGBA(254, 201, 1, 255));
-			nvgStroke(args.vg);
+	// A triggered sweep like an ordinary scope's, left to right over SIGHT_SWEEP_SIZE samples, starting when
+	// channel 1 rises past 1V. Every sweep lands on top of the ones before, so jitter and drift show up as smear.
+	// Only new samples are drawn into the image; the rest of the work per frame is fading and uploading it.
+	void drawPersistence(NVGcontext* vg, int channelCount) {
+		int width = std::max(1, (int)std::ceil(box.size.x));
+		int height = std::max(1, (int)std::ceil(box.size.y));
+		if (width != glowWidth || height != glowHeight) {
+			glowWidth = width;
+			glowHeight = height;
+			glow.assign(width * height, 0.f);
+			glowChannels.assign(width * height, 0);
+			glowPixels.assign(width * height * 4, 0);
+			glowImageSized = false;
+		}
 
-			// Set the line thickness for the next segment
-			nvgStrokeWidth(args.vg, thicknessEnd);
+		uint32_t end = module->ring.writeCount.load(std::memory_order_acquire);
+		int count = glowCounting ? (int)std::min(end - glowCount, (uint32_t)SIGHT_RING_SIZE / 2) : 0;
+		glowCount = end;
+		glowCounting = true;
+		glowBuffer.resize(count * groups);
+		if (count > 0 && !module->ring.copy(glowBuffer.data(), end, count, groups)) {
+			count = 0; // Too far behind, pick up from here next frame
+			sweepPosition = -1;
+		}
 
-			// Draw a dot at the start of the current segment
-			nvgBeginPath(args.vg);
-			nvgCircle(args.vg, position1, box.size.y - rescale(voltageBuffer[i], -10.f, 10.f, 0.f, box.size.y), thicknessStart / 2);
-			nvgFillColor(args.vg, nvgRGBA(254, 201, 1, 255));
-			nvgFill(args.vg);
+		// Oldest new sample first
+		for (int i = count - 1; i >= 0; i--) {
+			const simd::float_4* sample = &glowBuffer[i * groups];
+			bool triggered = sweepTrigger.process(sample[0][0], 0.1f, 1.f);
+			if (sweepPosition < 0) {
+				sweepWait++;
+				if (!triggered && sweepWait < SIGHT_SWEEP_SIZE) continue;
+				sweepPosition = 0;
+				sweepWait = 0;
+				std::fill(sweepLastY, sweepLastY + SIGHT_CHANNELS, -1);
+			}
+			int x = sweepPosition * glowWidth / SIGHT_SWEEP_SIZE;
+			for (int channel = channelCount - 1; channel >= 0; channel--) {
+				int y = clamp((int)voltageToY(sample[channel / 4][channel % 4]), 0, glowHeight - 1);
+				int lastY = sweepLastY[channel] < 0 ? y : sweepLastY[channel];
+				for (int row = std::min(y, lastY); row <= std::max(y, lastY); row++) {
+					glow[row * glowWidth + x] = 1.f;
+					glowChannels[row * glowWidth + x] = channel;
+				}
+				sweepLastY[channel] = y;
+			}
+			if (++sweepPosition == SIGHT_SWEEP_SIZE) {
+				sweepPosition = -1;
+			}
 		}
 
-		float position3 = precomputedPositions[bufferSize - 1];
+		uint8_t colors[SIGHT_CHANNELS][3];
+		for (int channel = 0; channel < SIGHT_CHANNELS; channel++) {
+			NVGcolor color = channelColor(channel);
+			colors[channel][0] = (uint8_t)(color.r * 255.f);
+			colors[channel][1] = (uint8_t)(color.g * 255.f);
+			colors[channel][2] = (uint8_t)(color.b * 255.f);
+		}
+		for (int i = 0; i < glowWidth * glowHeight; i++) {
+			float brightness = glow[i];
+			if (brightness == 0.f) {
+				glowPixels[i * 4 + 3] = 0;
+				continue;
+			}
+			const uint8_t* color = colors[glowChannels[i]];
+			glowPixels[i * 4 + 0] = color[0];
+			glowPixels[i * 4 + 1] = color[1];
+			glowPixels[i * 4 + 2] = color[2];
+			glowPixels[i * 4 + 3] = (uint8_t)(brightness * 255.f);
+			brightness *= SIGHT_GLOW_DECAY;
+			glow[i] = (brightness < 1.f / 255.f) ? 0.f : brightness;
+		}
 
-		// Draw the last segment (to ensure the thickness is applied)
-		nvgBeginPath(args.vg);
-		nvgMoveTo(args.vg, position3, box.size.y - rescale(voltageBuffer[bufferSize - 1], -10.f, 10.f, 0.f, box.size.y));
-		nvgLineTo(args.vg, position3, box.size.y - rescale(voltageBuffer[bufferSize - 1], -10.f, 10.f, 0.f, box.size.y));
-		nvgStroke(args.vg);
+		if (!glowImageSized) {
+			if (glowImage >= 0) nvgDeleteImage(vg, glowImage);
+			glowImage = nvgCreateImageRGBA(vg, glowWidth, glowHeight, NVG_IMAGE_NEAREST, glowPixels.data());
+			glowImageSized = true;
+		} else {
+			nvgUpdateImage(vg, glowImage, glowPixels.data());
+		}
+		if (glowImage < 0) return;
 
-		// Draw a dot at the last sample
-		nvgBeginPath(args.vg);
-		float thicknessLast = 4.f * (1.f - scalingFactors[bufferSize - 1]);
-		nvgCircle(args.vg, position3, box.size.y - rescale(voltageBuffer[bufferSize - 1], -10.f, 10.f, 0.f, box.size.y), thicknessLast / 2);
-		nvgFillColor(args.vg, nvgRGBA(254, 201, 1, 255));
-		nvgFill(args.vg);
+		nvgBeginPath(vg);
+		nvgRect(vg, 0, 0, glowWidth, glowHeight);
+		nvgFillPaint(vg, nvgImagePattern(vg, 0, 0, glowWidth, glowHeight, 0, glowImage, 1.f));
+		nvgFill(vg);
+	}
 
-		nvgResetScissor(args.vg);
+	// Strokes the columns in lowYs and highYs in order, as one path per thickness step.
+	// A packed column is a vertical stroke over its whole range, entered from whichever end
+	// is nearer to where the line came from.
+	void strokeColumns(NVGcontext* vg, const std::vector<TraceColumn>& lineColumns, float firstY) {
+		int columnCount = (int)lineColumns.size();
+		float lastY = firstY;
+		float lastX = lineColumns[0].x;
+		int pathStep = -1;
+		for (int c = 0; c < columnCount; c++) {
+			const TraceColumn& column = lineColumns[c];
+
+			if (column.thicknessStep != pathStep) {
+				if (pathStep >= 0) {
+					nvgStrokeWidth(vg, pathStep * 0.25f);
+					nvgStroke(vg);
+				}
+				// Start the next path where the last one left off, so the line stays joined up
+				nvgBeginPath(vg);
+				nvgMoveTo(vg, lastX, lastY);
+				pathStep = column.thicknessStep;
+			}
+
+			float lowY = lowYs[c];
+			float highY = highYs[c];
+			if (std::fabs(highY - lastY) < std::fabs(lowY - lastY)) {
+				std::swap(lowY, highY);
+			}
+			nvgLineTo(vg, column.x, lowY);
+			if (highY != lowY) {
+				nvgLineTo(vg, column.x, highY);
+			}
+			lastX = column.x;
+			lastY = highY;
+		}
+		nvgStrokeWidth(vg, pathStep * 0.25f);
+		nvgStroke(vg);
 	}
 };
 
@@ -225,6 +921,91 @@ struct SightWidget : ModuleWidget {
 		addChild(diagram);
 
 		addInput(createInputCentered<BrassPort>(mm2px(Vec(45.72, 112.842)), module, Sight::VOLTAGE_INPUT));
+		addParam(createParamCentered<BrassToggle>(mm2px(Vec(66.04, 112.842)), module, Sight::RECORD_SWITCH));
+	}
+
+	void step() override {
+		Sight* module = dynamic_cast<Sight*>(this->module);
+		if (module) {
+			module->updateRecording();
+		}
+		ModuleWidget::step();
+	}
+
+	// How long a number of samples lasts, roughly, in whatever unit reads best
+	static std::string durationText(double seconds) {
+		if (seconds < 60.0) return string::f("%.3g s", seconds);
+		if (seconds < 3600.0) return string::f("%.3g min", seconds / 60.0);
+		return string::f("%.3g h", seconds / 3600.0);
+	}
+
+	void appendContextMenu(Menu* menu) override {
+		Sight* module = dynamic_cast<Sight*>(this->module);
+		if (!module) return;
+
+		// Lengths are shown for the rate Sight is sampling at right now
+		bool audioRate = module->params[Sight::TOGGLE_SWITCH].getValue() >= 0.5f;
+		double sampleRate = audioRate ? APP->engine->getSampleRate() : 1000.0;
+
+		menu->addChild(new MenuSeparator());
+		menu->addChild(createMenuLabel("Display"));
+
+		menu->addChild(createCheckMenuItem("Trace (log time)", "",
+			[=]() { return module->displayMode == Sight::DISPLAY_TRACE; },
+			[=]() { module->displayMode = Sight::DISPLAY_TRACE; }
+		));
+
+		menu->addChild(createCheckMenuItem("Spectrum (log frequency)", "",
+			[=]() { return module->displayMode == Sight::DISPLAY_SPECTRUM; },
+			[=]() { module->displayMode = Sight::DISPLAY_SPECTRUM; }
+		));
+
+		menu->addChild(createCheckMenuItem("Persistence (triggered sweeps)", "",
+			[=]() { return module->displayMode == Sight::DISPLAY_PERSISTENCE; },
+			[=]() { module->displayMode = Sight::DISPLAY_PERSISTENCE; }
+		));
+
+		menu->addChild(new MenuSeparator());
+		menu->addChild(createMenuLabel("History"));
+
+		for (int octaves = SIGHT_MIN_OCTAVES; octaves <= SIGHT_MAX_OCTAVES; octaves += 3) {
+			menu->addChild(createCheckMenuItem(durationText(std::exp2(octaves) / sampleRate), "",
+				[=]() { return module->historyOctaves == octaves; },
+				[=]() { module->historyOctaves = octaves; }
+			));
+		}
+
+		menu->addChild(new MenuSeparator());
+		menu->addChild(createMenuLabel("Recording"));
+
+		menu->addChild(createCheckMenuItem("WAV (32-bit float)", "",
+			[=]() { return module->recordFormat == SightRecorder::WAV; },
+			[=]() { module->recordFormat = SightRecorder::WAV; }
+		));
+
+		menu->addChild(createCheckMenuItem("CSV", "",
+			[=]() { return module->recordFormat == SightRecorder::CSV; },
+			[=]() { module->recordFormat = SightRecorder::CSV; }
+		));
+
+		SightRecorder* activeRecorder = module->recorder.get();
+		if (activeRecorder) {
+			std::string status = durationText(activeRecorder->framesWritten / activeRecorder->sampleRate) + " written";
+			uint32_t dropped = activeRecorder->droppedBlocks;
+			if (dropped > 0) {
+				status += string::f(", %u blocks dropped", dropped);
+			}
+			menu->addChild(createMenuLabel("Recording " + module->recordingName));
+			menu->addChild(createMenuLabel(status));
+			menu->addChild(createMenuLabel("A change in channels carries on in a new file"));
+			menu->addChild(createMenuItem("Stop recording", "",
+				[=]() { module->params[Sight::RECORD_SWITCH].setValue(0.f); }
+			));
+		} else {
+			menu->addChild(createMenuItem("Start recording", "",
+				[=]() { module->params[Sight::RECORD_SWITCH].setValue(1.f); }
+			));
+		}
 	}
 };
 
@@ -0,0 +1,300 @@
+/*
+T's Musical Tools (TMT) - A collection of esoteric modules for VCV Rack, focused on manipulating RNG and polyphonic signals.
+Copyright (C) 2024  T
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define SIGHT_RECORD_BLOCK 1024   // Frames per block handed from the audio thread to the writer
+#define SIGHT_RECORD_BLOCKS 64    // Blocks in flight, a power of two; when they're all full, blocks get dropped
+
+// Streams what Sight captures to a WAV or CSV file on its own thread.
+// The audio thread only ever copies a frame into a block with push(), and hands full blocks over
+// through a lock-free queue; the writer thread drains them to disk in whole blocks and hands them back.
+// If the writer falls so far behind that no empty block is left, the audio thread drops frames
+// a block at a time and counts them in droppedBlocks, rather than waiting. Every block remembers which frame it
+// starts on, so what comes after a gap keeps its time: CSV rows carry the true time, and WAV files get silence.
+// Nobody waits on the audio thread to finish either: once it's done with a recorder, it gives up its last block with
+// retire(), and the owner then lets the writer finish the file with requestStop() and frees it once finished().
+// stop() and the destructor do all of that at once, so they're only for when the audio thread is known to be done.
+struct SightRecorder {
+    enum Format {
+        WAV,  // 32-bit float
+        CSV   // Seconds, then one column per channel
+    };
+
+    std::string path;
+    Format format;
+    int channels;
+    float sampleRate;
+
+    std::atomic<uint32_t> droppedBlocks{0};
+    std::atomic<uint64_t> framesWritten{0}; // Including any silence in place of dropped frames
+
+    SightRecorder(const std::string& path, Format format, int channels, float sampleRate)
+        : path(path), format(format), channels(channels), sampleRate(sampleRate) {
+        blocks.resize((size_t)SIGHT_RECORD_BLOCKS * SIGHT_RECORD_BLOCK * channels);
+        for (int block = 0; block < SIGHT_RECORD_BLOCKS; block++) {
+            emptyQueue[block] = block;
+        }
+        emptyTail = SIGHT_RECORD_BLOCKS;
+    }
+
+    ~SightRecorder() {
+        stop();
+    }
+
+    // Opens the file and starts the writer. Called from the UI thread.
+    bool start() {
+        out.open(path, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        writeHeader();
+        writer = std::thread([this]() { run(); });
+        return true;
+    }
+
+    // Hands over the last, partly filled block, writes out everything, finishes the file and joins the writer.
+    // Called from the UI thread, once the audio thread is done with push(), so its block is free to take.
+    void stop() {
+        retire();
+        requestStop();
+        if (writer.joinable()) {
+            writer.join();
+        }
+    }
+
+    // Hands over the last, partly filled block. Called by whichever thread last called push(), after its last push().
+    void retire() {
+        if (currentBlock >= 0 && currentFrames > 0) {
+            handOver();
+        }
+    }
+
+    // Lets the writer write out what it has been handed, finish the file and exit, without waiting for it.
+    // Called from the UI thread once retire() has been, and more than once is fine.
+    void requestStop() {
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            stopping = true;
+        }
+        wake.notify_one();
+    }
+
+    // Whether the file is finished and closed, so joining the writer won't block
+    bool finished() const {
+        return done.load(std::memory_order_acquire);
+    }
+
+    // Adds one frame of channels voltages. Audio thread only: no locks, no allocation, no file access.
+    void push(const float* voltages) {
+        uint64_t frame = framesPushed++;
+        if (currentBlock < 0) {
+            currentBlock = takeEmptyBlock();
+            if (currentBlock < 0) {
+                // Every block is waiting on the writer, so this block's worth of frames is lost
+                if (++skippedFrames == SIGHT_RECORD_BLOCK) {
+                    skippedFrames = 0;
+                    droppedBlocks++;
+                }
+                return;
+            }
+            if (skippedFrames > 0) {
+                skippedFrames = 0;
+                droppedBlocks++;
+            }
+            currentFrames = 0;
+            blockStart[currentBlock] = frame;
+        }
+
+        std::memcpy(&blocks[((size_t)currentBlock * SIGHT_RECORD_BLOCK + currentFrames) * channels], voltages, channels * sizeof(float));
+        if (++currentFrames == SIGHT_RECORD_BLOCK) {
+            handOver();
+        }
+    }
+
+  private:
+    std::vector<float> blocks;          // SIGHT_RECORD_BLOCKS blocks of SIGHT_RECORD_BLOCK frames
+    int blockFrames[SIGHT_RECORD_BLOCKS] = {}; // Frames in each full block, only short for the last one
+    uint64_t blockStart[SIGHT_RECORD_BLOCKS] = {}; // The frame each block starts on, counting dropped ones
+
+    // Block numbers go round in two single-producer single-consumer queues:
+    // full ones from the audio thread to the writer, and empty ones back again
+    int fullQueue[SIGHT_RECORD_BLOCKS];
+    std::atomic<uint32_t> fullHead{0}, fullTail{0};
+    int emptyQueue[SIGHT_RECORD_BLOCKS];
+    std::atomic<uint32_t> emptyHead{0}, emptyTail{0};
+
+    // Audio thread only, until stop()
+    int currentBlock = -1;
+    int currentFrames = 0;
+    int skippedFrames = 0;
+    uint64_t framesPushed = 0;
+
+    std::ofstream out;
+    uint64_t dataBytes = 0;
+    std::vector<char> text;             // CSV being formatted
+    std::vector<float> silence;         // A block of zeros for WAV gaps
+
+    std::thread writer;
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::atomic<bool> done{false};
+
+    int takeEmptyBlock() {
+        uint32_t head = emptyHead.load(std::memory_order_relaxed);
+        if (head == emptyTail.load(std::memory_order_acquire)) return -1;
+        int block = emptyQueue[head & (SIGHT_RECORD_BLOCKS - 1)];
+        emptyHead.store(head + 1, std::memory_order_release);
+        return block;
+    }
+
+    void handOver() {
+        blockFrames[currentBlock] = currentFrames;
+        uint32_t tail = fullTail.load(std::memory_order_relaxed);
+        fullQueue[tail & (SIGHT_RECORD_BLOCKS - 1)] = currentBlock; // Never full: there are only as many blocks as slots
+        fullTail.store(tail + 1, std::memory_order_release);
+        currentBlock = -1;
+    }
+
+    // Writes out every full block, and gives them back to the audio thread
+    void drain() {
+        while (true) {
+            uint32_t head = fullHead.load(std::memory_order_relaxed);
+            if (head == fullTail.load(std::memory_order_acquire)) return;
+            int block = fullQueue[head & (SIGHT_RECORD_BLOCKS - 1)];
+            fullHead.store(head + 1, std::memory_order_release);
+
+            writeBlock(&blocks[(size_t)block * SIGHT_RECORD_BLOCK * channels], blockStart[block], blockFrames[block]);
+
+            uint32_t tail = emptyTail.load(std::memory_order_relaxed);
+            emptyQueue[tail & (SIGHT_RECORD_BLOCKS - 1)] = block;
+            emptyTail.store(tail + 1, std::memory_order_release);
+        }
+    }
+
+    static void put32(char* at, uint32_t value) {
+        for (int i = 0; i < 4; i++) at[i] = (char)((value >> (8 * i)) & 0xFF);
+    }
+
+    static void put16(char* at, uint16_t value) {
+        at[0] = (char)(value & 0xFF);
+        at[1] = (char)(value >> 8);
+    }
+
+    void writeHeader() {
+        if (format == CSV) {
+            std::string header = "seconds";
+            for (int channel = 0; channel < channels; channel++) {
+                header += ",channel " + std::to_string(channel + 1);
+            }
+            header += "\n";
+            out.write(header.data(), header.size());
+            return;
+        }
+        // Sizes are filled in by finishHeader() once they're known
+        char header[44];
+        std::memcpy(header, "RIFF\0\0\0\0WAVEfmt ", 16);
+        put32(header + 16, 16);
+        put16(header + 20, 3); // IEEE float
+        put16(header + 22, (uint16_t)channels);
+        put32(header + 24, (uint32_t)std::round(sampleRate));
+        put32(header + 28, (uint32_t)std::round(sampleRate) * channels * 4);
+        put16(header + 32, (uint16_t)(channels * 4));
+        put16(header + 34, 32);
+        std::memcpy(header + 36, "data\0\0\0\0", 8);
+        out.write(header, sizeof(header));
+    }
+
+    void finishHeader() {
+        if (format != WAV) return;
+        // RIFF sizes are 32 bits, so a capture past 4GB still plays up to there
+        uint32_t size = (uint32_t)std::min<uint64_t>(dataBytes, 0xFFFFFFFFull - 36);
+        char field[4];
+        out.seekp(4);
+        put32(field, size + 36);
+        out.write(field, 4);
+        out.seekp(40);
+        put32(field, size);
+        out.write(field, 4);
+    }
+
+    void writeBlock(const float* frames, uint64_t start, int frameCount) {
+        if (format == WAV) {
+            // Frames that were dropped before this block become silence, so everything after keeps its time
+            if (start > framesWritten) {
+                silence.resize((size_t)SIGHT_RECORD_BLOCK * channels, 0.f);
+                for (uint64_t gap = start - framesWritten; gap > 0;) {
+                    size_t gapFrames = (size_t)std::min<uint64_t>(gap, SIGHT_RECORD_BLOCK);
+                    out.write((const char*)silence.data(), gapFrames * channels * sizeof(float));
+                    dataBytes += gapFrames * channels * sizeof(float);
+                    gap -= gapFrames;
+                }
+            }
+            // Little-endian floats, like every platform Rack runs on
+            size_t bytes = (size_t)frameCount * channels * sizeof(float);
+            out.write((const char*)frames, bytes);
+            dataBytes += bytes;
+        } else {
+            // Rows are stamped with their own frame, so a gap shows up as a jump in time
+            text.clear();
+            char number[32];
+            uint64_t frame = start;
+            for (int i = 0; i < frameCount; i++, frame++) {
+                int length = std::snprintf(number, sizeof(number), "%.6f", frame / sampleRate);
+                text.insert(text.end(), number, number + length);
+                for (int channel = 0; channel < channels; channel++) {
+                    length = std::snprintf(number, sizeof(number), ",%.6g", frames[i * channels + channel]);
+                    text.insert(text.end(), number, number + length);
+                }
+                text.push_back('\n');
+            }
+            out.write(text.data(), text.size());
+        }
+        framesWritten = start + frameCount;
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        while (!stopping) {
+            lock.unlock();
+            drain();
+            lock.lock();
+            // The audio thread doesn't notify, so check back a few times a second; there are blocks to spare
+            wake.wait_for(lock, std::chrono::milliseconds(50));
+        }
+        lock.unlock();
+
+        drain();
+        finishHeader();
+        out.close();
+        done.store(true, std::memory_order_release);
+    }
+};
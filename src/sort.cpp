@@ -18,8 +18,12 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "plugin.hpp"
 #include "ports.hpp"
+#include "sort_expander.hpp"
+#include <array>
+#include <cmath>
 
 #define GRID_SNAP 10.16 // A 2hp grid in millimeters. 1 GRID_SNAP is just the right spacing for adjacent ports on the module
+#define SORT_SUSTAINED_CHANGES 32 // Samples in a row that have to change before re-sorting is throttled
 
 struct Timer {
 	// There's probably something in dsp which could handle this better,
@@ -37,6 +41,64 @@ struct Timer {
 	bool check(float seconds) { return timePassed >= seconds; } // Return whether it's been at least <seconds> since the timer started
 };
 
+// Sorting networks: fixed lists of compare-and-swap pairs that sort any input of their size, with no branching on the data
+// beyond each swap. Channels past the real count are padded with +infinity, so each network covers every count up to its size.
+// These are the smallest known networks for 4, 8 and 16 inputs (5, 19 and 60 comparisons).
+static const uint8_t SORT_NETWORK_4[][2] = {
+	{0, 1}, {2, 3}, {0, 2}, {1, 3}, {1, 2}
+};
+static const uint8_t SORT_NETWORK_8[][2] = {
+	{0, 2}, {1, 3}, {4, 6}, {5, 7}, {0, 4}, {1, 5}, {2, 6}, {3, 7}, {0, 1}, {2, 3}, {4, 5}, {6, 7},
+	{2, 4}, {3, 5}, {1, 4}, {3, 6}, {1, 2}, {3, 4}, {5, 6}
+};
+static const uint8_t SORT_NETWORK_16[][2] = {
+	{0, 13}, {1, 12}, {2, 15}, {3, 14}, {4, 8}, {5, 6}, {7, 11}, {9, 10},
+	{0, 5}, {1, 7}, {2, 9}, {3, 4}, {6, 13}, {8, 14}, {10, 15}, {11, 12},
+	{0, 1}, {2, 3}, {4, 5}, {6, 8}, {7, 9}, {10, 11}, {12, 13}, {14, 15},
+	{0, 2}, {1, 3}, {4, 10}, {5, 11}, {6, 7}, {8, 9}, {12, 14}, {13, 15},
+	{1, 2}, {3, 12}, {4, 6}, {5, 7}, {8, 10}, {9, 11}, {13, 14},
+	{1, 4}, {2, 6}, {5, 8}, {7, 10}, {9, 13}, {11, 14},
+	{2, 4}, {3, 6}, {9, 12}, {11, 13},
+	{3, 5}, {6, 8}, {7, 9}, {10, 12},
+	{3, 4}, {5, 6}, {7, 8}, {9, 10}, {11, 12},
+	{6, 7}, {8, 9}
+};
+
+typedef std::array<float, 16> Channels;
+typedef std::array<int, 16> Ordering;
+
+// Puts the channel numbers in order of their keys, lowest first, with ties left in channel order like a stable sort.
+// Only the first count entries of order mean anything.
+static void argsort(const Channels& keys, int count, Ordering& order) {
+	float sorted[16];
+	for (int i = 0; i < 16; i++) {
+		sorted[i] = (i < count) ? keys[i] : INFINITY;
+		order[i] = i;
+	}
+
+	const uint8_t (*network)[2] = SORT_NETWORK_16;
+	int comparisons = sizeof(SORT_NETWORK_16) / sizeof(SORT_NETWORK_16[0]);
+	if (count <= 4) {
+		network = SORT_NETWORK_4;
+		comparisons = sizeof(SORT_NETWORK_4) / sizeof(SORT_NETWORK_4[0]);
+	} else if (count <= 8) {
+		network = SORT_NETWORK_8;
+		comparisons = sizeof(SORT_NETWORK_8) / sizeof(SORT_NETWORK_8[0]);
+	}
+	if (count < 2) return;
+
+	for (int c = 0; c < comparisons; c++) {
+		int a = network[c][0];
+		int b = network[c][1];
+		// Comparing channel numbers on ties makes every entry distinct, so the network's result is the stable one
+		bool swap = sorted[b] < sorted[a] || (sorted[b] == sorted[a] && order[b] < order[a]);
+		if (swap) {
+			std::swap(sorted[a], sorted[b]);
+			std::swap(order[a], order[b]);
+		}
+	}
+}
+
 struct Sort : Module {
 	enum ParamId {
 		TOGGLE_SWITCH,
@@ -64,10 +126,23 @@ struct Sort : Module {
 	
 	Timer timeSinceUpdate;
 
+	// The inputs as of the last time they changed, to tell whether there's anything to re-sort; see inputsChanged()
+	simd::float_4 lastInputs[3][4];
+	int lastChannels = -1;
+	bool lastSortConnected = false;
+	bool lastSelectConnected = false;
+	int lastOutputsConnected = 0;
+	bool changePending = false; // Something changed that the outputs don't show yet
+	int changedRun = 0; // Samples in a row with a change, up to just past SORT_SUSTAINED_CHANGES
+
+	// The order of the Sorted output as of the last re-sort, sent on to any Order expanders to our right
+	Ordering sortedOrder = {};
+	int sortedChannels = 0;
+
 	Sort() {
 		config(PARAMS_LEN, INPUTS_LEN, OUTPUTS_LEN, LIGHTS_LEN);
 		// Configures the toggle switch parameter that determines the processing mode of the module.
-		configParam(TOGGLE_SWITCH, 0.f, 1.f, 0.f, "Alt Mode: Process at audio rate (CPU heavy)");
+		configParam(TOGGLE_SWITCH, 0.f, 1.f, 0.f, "Alt Mode: Re-sort on every change, even at audio rate (CPU heavy)");
 		
 		// Configures the inputs and outputs with descriptions for each port.
 		
@@ -112,104 +187,158 @@ struct Sort : Module {
 		outputInfos[DESCENDING_OUTPUT]->description = "- Outputs data sorted in descending order based on its own values, ignoring the 'Sort Key'.\n- This is a simple descending sort of the 'Data Input'.";
 
 		timeSinceUpdate.reset();
+		for (int p = 0; p < 3; p++) {
+			for (int g = 0; g < 4; g++) {
+				lastInputs[p][g] = 0.f;
+			}
+		}
+	}
+
+	// Compares the inputs against how they were last time, four channels at a time, and remembers any that changed.
+	// Newly patched outputs count as a change too, since they start out with a single channel until written.
+	bool inputsChanged(int channels) {
+		bool sortConnected = inputs[SORT_INPUT].isConnected();
+		bool selectConnected = inputs[SELECT_INPUT].isConnected();
+		int outputsConnected = 0;
+		for (int i = 0; i < OUTPUTS_LEN; i++) {
+			if (outputs[i].isConnected()) outputsConnected |= 1 << i;
+		}
+		bool changed = channels != lastChannels || sortConnected != lastSortConnected
+			|| selectConnected != lastSelectConnected || outputsConnected != lastOutputsConnected;
+		lastChannels = channels;
+		lastSortConnected = sortConnected;
+		lastSelectConnected = selectConnected;
+		lastOutputsConnected = outputsConnected;
+
+		const int ports[3] = {DATA_INPUT, SORT_INPUT, SELECT_INPUT};
+		const bool connected[3] = {true, sortConnected, selectConnected};
+		for (int p = 0; p < 3; p++) {
+			if (!connected[p]) continue; // Reads as all zeros, and a change of connection is caught above
+			for (int c = 0; c < channels; c += 4) {
+				simd::float_4 voltages = inputs[ports[p]].getVoltageSimd<simd::float_4>(c);
+				int lanes = (1 << std::min(channels - c, 4)) - 1; // Only the channels in use
+				if (simd::movemask(voltages != lastInputs[p][c / 4]) & lanes) {
+					lastInputs[p][c / 4] = voltages;
+					changed = true;
+				}
+			}
+		}
+		return changed;
+	}
+
+	// Sends the order of the Sorted output to the right expander (if it's an Order)
+	void sendOrder() {
+		if (rightExpander.module && rightExpander.module->model == modelOrder) {
+			SortExpanderMessage* message = (SortExpanderMessage*)rightExpander.module->leftExpander.producerMessage;
+			message->channels = sortedChannels;
+			for (int i = 0; i < 16; i++) {
+				message->order[i] = sortedOrder[i];
+			}
+			rightExpander.module->leftExpander.messageFlipRequested = true;
+		}
 	}
 
-	
 	void process(const ProcessArgs& args) override {
+		resort(args);
+		sendOrder();
+	}
+
+	void resort(const ProcessArgs& args) {
 		timeSinceUpdate.update(args.sampleTime); // Advance the timer
 		
 		if (!inputs[DATA_INPUT].isConnected()) {
 			for (int i = 0; i < OUTPUTS_LEN; ++i) {
 				outputs[i].setChannels(0); // Ensure no output
 			}
+			lastChannels = -1; // So everything gets worked out again when it's reconnected
+			sortedChannels = 0;
 			return; // Exit early if there's no input
 		}
-		
-		if (!timeSinceUpdate.check(0.01f) && params[TOGGLE_SWITCH].getValue() < 0.5f) {
+
+		int maxChannels = std::min(inputs[DATA_INPUT].getChannels(), 16);
+
+		// Only re-sort when something changed. Steady CV costs next to nothing, and a change shows up on the very next sample.
+		if (inputsChanged(maxChannels)) {
+			changePending = true;
+			if (changedRun <= SORT_SUSTAINED_CHANGES) {
+				changedRun++;
+			}
+		} else {
+			changedRun = 0;
+		}
+		if (!changePending) {
+			return;
+		}
+
+		// Inputs that keep changing, like audio, are only re-sorted every 10ms unless we're in Alt mode.
+		// Steps, short glides and the first samples of anything else go straight through,
+		// and whatever is held back comes through as soon as the input settles.
+		if (changedRun > SORT_SUSTAINED_CHANGES && !timeSinceUpdate.check(0.01f) && params[TOGGLE_SWITCH].getValue() < 0.5f) {
 			return; // Break early if we haven't reached our throttle time, unless we're in Alt mode
 		}
-		
-		timeSinceUpdate.reset(); // Reset the timer
 
-		int maxChannels = inputs[DATA_INPUT].getChannels();
-		
-		std::vector<float> dataValues(maxChannels);
-		std::vector<float> sortValues(maxChannels);
-		std::vector<float> selectValues(maxChannels);
+		timeSinceUpdate.reset(); // Reset the timer
+		changePending = false;
 
+		Channels dataValues = {};
+		Channels sortValues = {};
+		Channels selectValues = {};
+		bool sortConnected = inputs[SORT_INPUT].isConnected();
+		bool selectConnected = inputs[SELECT_INPUT].isConnected();
 		for (int i = 0; i < maxChannels; i++) {
 			dataValues[i] = inputs[DATA_INPUT].getVoltage(i);
-			sortValues[i] = inputs[SORT_INPUT].isConnected() ? inputs[SORT_INPUT].getVoltage(i) : 0.0f;
-			selectValues[i] = inputs[SELECT_INPUT].isConnected() ? inputs[SELECT_INPUT].getVoltage(i) : 0.0f;
+			sortValues[i] = sortConnected ? inputs[SORT_INPUT].getVoltage(i) : 0.0f;
+			selectValues[i] = selectConnected ? inputs[SELECT_INPUT].getVoltage(i) : 0.0f;
 		}
 
-		// Ascending and Descending sorting of dataValues
-		std::vector<float> ascendingData = dataValues;
-		std::sort(ascendingData.begin(), ascendingData.end());
-		std::vector<float> descendingData = ascendingData; // Copy already sorted data
-		std::reverse(descendingData.begin(), descendingData.end()); // Reverse for descending order
+		// One ordering by the data's own values feeds Ascending, Descending and Selected and Sorted,
+		// and one by the sort key feeds Sorted and Sorted and Selected
+		Ordering byValue;
+		Ordering byKey;
+		argsort(dataValues, maxChannels, byValue);
+		argsort(sortValues, maxChannels, byKey);
+		sortedOrder = byKey;
+		sortedChannels = maxChannels;
 
 		// Outputs
 		outputs[PASSTHRU_OUTPUT].setChannels(maxChannels);
 		outputs[ASCENDING_OUTPUT].setChannels(maxChannels);
 		outputs[DESCENDING_OUTPUT].setChannels(maxChannels);
+		outputs[SORTED_OUTPUT].setChannels(maxChannels);
 
 		for (int i = 0; i < maxChannels; i++) {
 			outputs[PASSTHRU_OUTPUT].setVoltage(dataValues[i], i);
-			outputs[ASCENDING_OUTPUT].setVoltage(ascendingData[i], i);
-			outputs[DESCENDING_OUTPUT].setVoltage(descendingData[i], i);
-		}
-
-		// Create a sorting index based on sortValues
-		std::vector<int> index(maxChannels);
-		std::iota(index.begin(), index.end(), 0);
-		std::stable_sort(index.begin(), index.end(), [&sortValues](int i, int j) { return sortValues[i] < sortValues[j]; });
-
-		// Apply sort to dataValues
-		std::vector<float> sortedData(maxChannels);
-		for (int i = 0; i < maxChannels; i++) {
-			sortedData[i] = dataValues[index[i]];
-		}
-		
-		outputs[SORTED_OUTPUT].setChannels(maxChannels);
-		for (int i = 0; i < maxChannels; i++) {
-			outputs[SORTED_OUTPUT].setVoltage(sortedData[i], i);
+			outputs[ASCENDING_OUTPUT].setVoltage(dataValues[byValue[i]], i);
+			outputs[DESCENDING_OUTPUT].setVoltage(dataValues[byValue[maxChannels - 1 - i]], i);
+			outputs[SORTED_OUTPUT].setVoltage(dataValues[byKey[i]], i);
 		}
 
 		// Apply selection
-		std::vector<float> selectedData;
+		int selectedCount = 0;
 		for (int i = 0; i < maxChannels; i++) {
 			if (selectValues[i] >= 1.0f) {
-				selectedData.push_back(dataValues[i]);
+				outputs[SELECTED_OUTPUT].setVoltage(dataValues[i], selectedCount++);
 			}
 		}
-
-		outputs[SELECTED_OUTPUT].setChannels(selectedData.size());
-		for (size_t i = 0; i < selectedData.size(); i++) {
-			outputs[SELECTED_OUTPUT].setVoltage(selectedData[i], i);
-		}
+		outputs[SELECTED_OUTPUT].setChannels(selectedCount);
 
 		// Sort the data, then select
-		std::vector<float> sortedSelectedData;
+		int sortedSelectedCount = 0;
 		for (int i = 0; i < maxChannels; i++) {
-			if (selectValues[index[i]] >= 1.0f) {
-				sortedSelectedData.push_back(sortedData[i]);
+			if (selectValues[byKey[i]] >= 1.0f) {
+				outputs[SORTED_AND_SELECTED_OUTPUT].setVoltage(dataValues[byKey[i]], sortedSelectedCount++);
 			}
 		}
-
-		outputs[SORTED_AND_SELECTED_OUTPUT].setChannels(sortedSelectedData.size());
-		for (size_t i = 0; i < sortedSelectedData.size(); i++) {
-			outputs[SORTED_AND_SELECTED_OUTPUT].setVoltage(sortedSelectedData[i], i);
-		}
+		outputs[SORTED_AND_SELECTED_OUTPUT].setChannels(sortedSelectedCount);
 
 		// Select data, then sort it
-		std::vector<float> selectedAndSortedData = selectedData;
-		std::sort(selectedAndSortedData.begin(), selectedAndSortedData.end());
-
-		outputs[SELECTED_AND_SORTED_OUTPUT].setChannels(selectedAndSortedData.size());
-		for (size_t i = 0; i < selectedAndSortedData.size(); i++) {
-			outputs[SELECTED_AND_SORTED_OUTPUT].setVoltage(selectedAndSortedData[i], i);
+		int selectedSortedCount = 0;
+		for (int i = 0; i < maxChannels; i++) {
+			if (selectValues[byValue[i]] >= 1.0f) {
+				outputs[SELECTED_AND_SORTED_OUTPUT].setVoltage(dataValues[byValue[i]], selectedSortedCount++);
+			}
 		}
+		outputs[SELECTED_AND_SORTED_OUTPUT].setChannels(selectedSortedCount);
 	}
 
 };
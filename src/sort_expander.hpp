@@ -0,0 +1,26 @@
+/*
+T's Musical Tools (TMT) - A collection of esoteric modules for VCV Rack, focused on manipulating RNG and polyphonic signals.
+Copyright (C) 2024  T
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// Expander message structure shared between Sort and Order modules
+// Sort sends the order it sorted by, so Order can reorder more cables the same way without sorting again
+struct SortExpanderMessage {
+    int channels = 0;     // Channels on Sort's Data input, 0 when it's unpatched
+    int order[16] = {};   // Source channel for each channel of Sort's Sorted output
+};
@@ -0,0 +1,190 @@
+/*
+T's Musical Tools (TMT) - A collection of esoteric modules for VCV Rack, focused on manipulating RNG and polyphonic signals.
+Copyright (C) 2024  T
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Platform file reading and change watching for Spellbook's external sequence files.
+// Kept apart from spellbook.cpp so windows.h never meets the Rack headers.
+
+#include "spellbook_file.hpp"
+
+#if defined ARCH_WIN
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined ARCH_LIN
+#include <sys/inotify.h>
+#endif
+
+#if defined ARCH_WIN
+
+bool readFileSnapshot(const std::string& path, std::string& contents) {
+    // Rack paths are UTF-8, Windows wants UTF-16
+    int wideLength = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, NULL, 0);
+    if (wideLength <= 0) return false;
+    std::wstring widePath(wideLength, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, &widePath[0], wideLength);
+
+    // Share everything, so editors can still save over the file while we read it
+    HANDLE file = CreateFileW(widePath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                              NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER fileSize;
+    contents.clear();
+    if (GetFileSizeEx(file, &fileSize)) {
+        contents.reserve((size_t)fileSize.QuadPart);
+    }
+    char buffer[1 << 16];
+    DWORD length = 0;
+    bool ok = true;
+    while (true) {
+        if (!ReadFile(file, buffer, sizeof(buffer), &length, NULL)) {
+            ok = false;
+            break;
+        }
+        if (length == 0) break;
+        contents.append(buffer, length);
+    }
+    CloseHandle(file);
+    return ok;
+}
+
+#else
+
+bool readFileSnapshot(const std::string& path, std::string& contents) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    struct stat info;
+    contents.clear();
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        contents.reserve((size_t)info.st_size);
+    }
+    char buffer[1 << 16];
+    bool ok = true;
+    while (true) {
+        ssize_t length = ::read(fd, buffer, sizeof(buffer));
+        if (length < 0) {
+            if (errno == EINTR) continue;
+            ok = false;
+            break;
+        }
+        if (length == 0) break;
+        contents.append(buffer, (size_t)length);
+    }
+    ::close(fd);
+    return ok;
+}
+
+#endif
+
+#if defined ARCH_LIN
+
+// Watches the file's directory rather than the file, because most editors and scripts save by
+// writing a new file and renaming it over the old one, which would leave a watch on the file itself dangling.
+bool FileWatcher::open(const std::string& path) {
+    close();
+    this->path = path;
+    descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (descriptor < 0) return false;
+    size_t slash = path.find_last_of('/');
+    std::string directory = (slash == std::string::npos) ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+    if (inotify_add_watch(descriptor, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool FileWatcher::changed() {
+    if (descriptor < 0) return false;
+    std::string name = path.substr(path.find_last_of('/') + 1);
+    bool fileChanged = false;
+    alignas(struct inotify_event) char buffer[4096];
+    while (true) {
+        ssize_t length = read(descriptor, buffer, sizeof(buffer));
+        if (length <= 0) break; // EAGAIN: nothing more to read
+        for (char* event = buffer; event < buffer + length;) {
+            const struct inotify_event* info = (const struct inotify_event*)event;
+            if (info->len > 0 && name == info->name) {
+                fileChanged = true;
+            }
+            event += sizeof(struct inotify_event) + info->len;
+        }
+    }
+    return fileChanged;
+}
+
+void FileWatcher::close() {
+    if (descriptor >= 0) {
+        ::close(descriptor);
+    }
+    descriptor = -1;
+}
+
+#else
+
+// No inotify here, so look at the file's size and modification time a couple of times a second
+static bool fileStamp(const std::string& path, int64_t& modified, int64_t& size) {
+#if defined ARCH_WIN
+    int wideLength = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, NULL, 0);
+    if (wideLength <= 0) return false;
+    std::wstring widePath(wideLength, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, &widePath[0], wideLength);
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (!GetFileAttributesExW(widePath.c_str(), GetFileExInfoStandard, &attributes)) return false;
+    modified = ((int64_t)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+    size = ((int64_t)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+#else
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) return false;
+    modified = (int64_t)info.st_mtime;
+    size = (int64_t)info.st_size;
+#endif
+    return true;
+}
+
+bool FileWatcher::open(const std::string& path) {
+    this->path = path;
+    lastPoll = std::chrono::steady_clock::now();
+    return fileStamp(path, lastModified, lastSize);
+}
+
+bool FileWatcher::changed() {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (now - lastPoll < std::chrono::milliseconds(500)) return false;
+    lastPoll = now;
+    int64_t modified, size;
+    if (!fileStamp(path, modified, size)) return false; // Gone for now, maybe mid-save
+    if (modified == lastModified && size == lastSize) return false;
+    lastModified = modified;
+    lastSize = size;
+    return true;
+}
+
+void FileWatcher::close() {
+    lastSize = -1;
+}
+
+#endif
@@ -0,0 +1,356 @@
+/*
+T's Musical Tools (TMT) - A collection of esoteric modules for VCV Rack, focused on manipulating RNG and polyphonic signals.
+Copyright (C) 2024  T
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "spellbook_sequence.hpp"
+
+#define SPELLBOOK_PAGE_ROWS 1024      // Rows compiled at a time from an external file
+#define SPELLBOOK_RESIDENT_PAGES 8    // Compiled pages kept around, least recently used go first
+
+// Reads a whole file into memory, replacing contents. Implemented per platform in spellbook_file.cpp.
+// The file is only open while it's read, so it can be rewritten or truncated at any time afterwards
+// without pulling the data out from under us, and editors that save in place never find it locked.
+bool readFileSnapshot(const std::string& path, std::string& contents);
+
+// Notices when a file on disk changes: inotify on Linux, otherwise by checking its size and modification time.
+// Implemented per platform in spellbook_file.cpp. changed() never blocks.
+struct FileWatcher {
+    std::string path;
+    int descriptor = -1;        // inotify instance, Linux only
+    int64_t lastModified = 0;   // Polling fallback
+    int64_t lastSize = -1;
+    std::chrono::steady_clock::time_point lastPoll;
+
+    bool open(const std::string& path);
+    bool changed();
+    void close();
+
+    ~FileWatcher() {
+        close();
+    }
+};
+
+// An external RhythML/CSV file bound to a Spellbook, compiled a page of rows at a time on its own thread.
+// The engine only ever asks for pages with tryGetPageAt() and says where it's playing with wantedStep,
+// so it never waits on the disk or the parser.
+// Each page is a CompiledSequence of just its rows, with firstStep set to where it starts in the file.
+// Section headers and play orders are skipped in files: the rows play in the order they're written.
+// The file is read into memory in one go and everything works from that copy, never from the file itself.
+// When watching, a changed file is read again and compared with the last copy. Only the pages around what changed
+// are split up again and recompiled; the pages after it keep their compiled rows and just move to their new steps.
+// The engine notices the new generation and swaps pages in the next time it changes step.
+struct SpellbookFile {
+    typedef std::function<std::shared_ptr<CompiledSequence>(const std::string&)> CompileFunction;
+
+    // A run of rows compiled together. Pages start out SPELLBOOK_PAGE_ROWS long,
+    // but the ones a reload splits up again can be shorter.
+    struct PageSpan {
+        size_t start;   // Byte offset of its first row's line
+        int firstRow;   // Step it starts at
+        int rows;
+    };
+
+    std::string path;
+    std::string snapshot;               // The file as it was last read, owned by the worker
+    CompileFunction compile;
+
+    std::atomic<bool> indexed{false};   // Set once rowCount and spans are first filled in
+    std::atomic<int> wantedStep{-1};    // Step the playhead is on; its page is kept resident along with its neighbours
+    std::atomic<bool> watching{false};  // Reload when the file changes
+    std::atomic<int> rowCount{0};
+    std::atomic<int> generation{0};     // Bumped on every reload, so the engine knows its page may be stale
+    std::vector<PageSpan> spans;        // Every page in order. Only the worker changes it, with pagesMutex held
+
+    struct Page {
+        std::shared_ptr<const CompiledSequence> sequence;
+        uint64_t lastUsed;
+    };
+    std::mutex pagesMutex;
+    std::map<int, Page> pages;
+    uint64_t useCounter = 0;
+
+    std::thread worker;
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    SpellbookFile(const std::string& path, CompileFunction compile) : path(path), compile(compile) {}
+
+    ~SpellbookFile() {
+        stop();
+    }
+
+    // Reads the file and starts indexing and compiling it in the background
+    bool start() {
+        if (!readFileSnapshot(path, snapshot)) return false;
+        worker = std::thread([this]() { run(); });
+        return true;
+    }
+
+    // Joins the worker. Pages already compiled stay usable, so whoever is playing can keep going until swapped out.
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    // Never blocks: returns null if the page holding step isn't compiled yet, or if the worker happens to hold the lock.
+    // Also says which generation of the file the page belongs to.
+    std::shared_ptr<const CompiledSequence> tryGetPageAt(int step, int& pageGeneration) {
+        std::unique_lock<std::mutex> lock(pagesMutex, std::try_to_lock);
+        if (!lock.owns_lock()) return nullptr;
+        auto it = pages.find(pageAt(step));
+        if (it == pages.end()) return nullptr;
+        it->second.lastUsed = ++useCounter;
+        pageGeneration = generation;
+        return it->second.sequence;
+    }
+
+  private:
+    // The page holding a step, or -1. Callers other than the worker hold pagesMutex.
+    int pageAt(int step) const {
+        auto after = std::upper_bound(spans.begin(), spans.end(), step,
+            [](int row, const PageSpan& span) { return row < span.firstRow; });
+        if (after == spans.begin()) return -1;
+        int page = (int)(after - spans.begin()) - 1;
+        return step < spans[page].firstRow + spans[page].rows ? page : -1;
+    }
+
+    // Calls row(offset, index) for the line of each row in text[from, to), and returns how many there were.
+    // Cheap directive check, just the first non-space character. Nothing is parsed here.
+    template <typename RowFunction>
+    static int forEachRow(const std::string& text, size_t from, size_t to, RowFunction row) {
+        size_t offset = from;
+        int rows = 0;
+        while (offset < to) {
+            const char* start = text.data() + offset;
+            const char* newline = (const char*)std::memchr(start, '\n', to - offset);
+            size_t length = newline ? (size_t)(newline - start) : to - offset;
+            size_t first = 0;
+            while (first < length && (start[first] == ' ' || start[first] == '\t')) first++;
+            bool directive = first < length && (start[first] == '@' || start[first] == '>');
+            if (!directive) {
+                row(offset, rows++);
+            }
+            offset += length + 1;
+        }
+        return rows;
+    }
+
+    // Splits the rows in text[from, to) into as few pages of at most SPELLBOOK_PAGE_ROWS as it can, as even as they can be,
+    // and adds them to newSpans starting at step firstRow. Returns how many rows there were.
+    static int splitPages(const std::string& text, size_t from, size_t to, int firstRow, std::vector<PageSpan>& newSpans) {
+        int rows = forEachRow(text, from, to, [](size_t, int) {});
+        if (rows == 0) return 0;
+        int pageCount = (rows + SPELLBOOK_PAGE_ROWS - 1) / SPELLBOOK_PAGE_ROWS;
+        int pageRows = (rows + pageCount - 1) / pageCount;
+        forEachRow(text, from, to, [&](size_t offset, int row) {
+            if (row % pageRows == 0) {
+                newSpans.push_back(PageSpan{offset, firstRow + row, std::min(pageRows, rows - row)});
+            }
+        });
+        return rows;
+    }
+
+    // The rows of a page as text, one per line, with section and play order lines left out
+    std::string pageText(int page) const {
+        const PageSpan& span = spans[page];
+        std::string text;
+        size_t offset = span.start;
+        int rows = 0;
+        while (offset < snapshot.size() && rows < span.rows) {
+            const char* start = snapshot.data() + offset;
+            const char* newline = (const char*)std::memchr(start, '\n', snapshot.size() - offset);
+            size_t length = newline ? (size_t)(newline - start) : snapshot.size() - offset;
+            offset += length + 1;
+            std::string line(start, length);
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (isSequenceDirective(line)) continue;
+            if (rows > 0) text += '\n';
+            text += line;
+            rows++;
+        }
+        return text;
+    }
+
+    void buildIndex() {
+        std::vector<PageSpan> newSpans;
+        int rows = splitPages(snapshot, 0, snapshot.size(), 0, newSpans);
+        std::lock_guard<std::mutex> lock(pagesMutex);
+        spans.swap(newSpans);
+        rowCount = rows;
+        indexed = true;
+    }
+
+    // Swaps in the file as it is on disk now. Everything up to the first line that changed and after the last one
+    // is the same text as before, so only the pages overlapping the lines in between are split up again,
+    // and only they need compiling again. Later pages keep their compiled rows and move by however many rows
+    // were added or taken away; their firstStep is fixed up on a copy, so the engine's page is never changed under it.
+    void reload() {
+        std::string newSnapshot;
+        if (!readFileSnapshot(path, newSnapshot)) return; // Probably mid-save, so wait for the next change
+        if (newSnapshot == snapshot) return;
+        const std::string& before = snapshot;
+        const std::string& after = newSnapshot;
+
+        // Bytes the two versions start and end with, widened to whole lines
+        size_t common = std::min(before.size(), after.size());
+        size_t editStart = 0;
+        while (editStart < common && before[editStart] == after[editStart]) editStart++;
+        while (editStart > 0 && before[editStart - 1] != '\n') editStart--;
+        size_t sameEnd = 0;
+        while (sameEnd < common - editStart && before[before.size() - 1 - sameEnd] == after[after.size() - 1 - sameEnd]) sameEnd++;
+        size_t beforeEnd = before.size() - sameEnd;
+        size_t afterEnd = after.size() - sameEnd;
+        while (beforeEnd < before.size() && !((beforeEnd == editStart || before[beforeEnd - 1] == '\n')
+                                              && (afterEnd == editStart || after[afterEnd - 1] == '\n'))) {
+            beforeEnd++;
+            afterEnd++;
+        }
+
+        // Pages [firstChanged, lastChanged) overlap the edit. Short pages next to it are split up along with it,
+        // so edits in the same place again and again don't leave a trail of tiny pages.
+        size_t count = spans.size();
+        size_t firstChanged = 0;
+        while (firstChanged < count && (firstChanged + 1 < count ? spans[firstChanged + 1].start : before.size()) <= editStart) {
+            firstChanged++;
+        }
+        size_t lastChanged = count;
+        while (lastChanged > firstChanged && spans[lastChanged - 1].start >= beforeEnd) {
+            lastChanged--;
+        }
+        if (firstChanged > 0 && spans[firstChanged - 1].rows < SPELLBOOK_PAGE_ROWS / 2) firstChanged--;
+        if (lastChanged < count && spans[lastChanged].rows < SPELLBOOK_PAGE_ROWS / 2) lastChanged++;
+
+        long long byteShift = (long long)after.size() - (long long)before.size();
+        size_t from = firstChanged < count ? std::min(spans[firstChanged].start, editStart) : editStart;
+        size_t to = lastChanged < count ? (size_t)((long long)spans[lastChanged].start + byteShift) : after.size();
+        int firstRow = firstChanged < count ? spans[firstChanged].firstRow : rowCount.load();
+        int oldEndRow = lastChanged < count ? spans[lastChanged].firstRow : rowCount.load();
+
+        std::vector<PageSpan> newSpans(spans.begin(), spans.begin() + firstChanged);
+        int middleRows = splitPages(after, from, to, firstRow, newSpans);
+        int rowShift = firstRow + middleRows - oldEndRow;
+        int pageShift = (int)newSpans.size() - (int)lastChanged;
+        for (size_t page = lastChanged; page < count; page++) {
+            const PageSpan& span = spans[page];
+            newSpans.push_back(PageSpan{(size_t)((long long)span.start + byteShift), span.firstRow + rowShift, span.rows});
+        }
+
+        std::lock_guard<std::mutex> lock(pagesMutex);
+        std::map<int, Page> keptPages;
+        for (const auto& entry : pages) {
+            int page = entry.first;
+            if (page < (int)firstChanged) {
+                keptPages[page] = entry.second;
+            } else if (page >= (int)lastChanged) {
+                Page moved = entry.second;
+                if (rowShift != 0) {
+                    std::shared_ptr<CompiledSequence> shifted = std::make_shared<CompiledSequence>(*moved.sequence);
+                    shifted->firstStep += rowShift;
+                    moved.sequence = shifted;
+                }
+                keptPages[page + pageShift] = moved;
+            }
+        }
+        pages.swap(keptPages);
+        spans.swap(newSpans);
+        snapshot.swap(newSnapshot);
+        rowCount += rowShift;
+        generation++;
+    }
+
+    bool isResident(int page) {
+        std::lock_guard<std::mutex> lock(pagesMutex);
+        return pages.count(page) > 0;
+    }
+
+    void compilePage(int page) {
+        std::shared_ptr<CompiledSequence> compiled = compile(pageText(page));
+        compiled->firstStep = spans[page].firstRow;
+
+        std::lock_guard<std::mutex> lock(pagesMutex);
+        pages[page] = Page{compiled, ++useCounter};
+        while (pages.size() > SPELLBOOK_RESIDENT_PAGES) {
+            auto oldest = pages.begin();
+            for (auto it = pages.begin(); it != pages.end(); ++it) {
+                if (it->second.lastUsed < oldest->second.lastUsed) oldest = it;
+            }
+            pages.erase(oldest);
+        }
+    }
+
+    void run() {
+        buildIndex();
+        FileWatcher watcher;
+        bool watcherOpen = false;
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        while (!stopping) {
+            if (watching) {
+                if (!watcherOpen) {
+                    watcherOpen = watcher.open(path);
+                } else if (watcher.changed()) {
+                    lock.unlock();
+                    reload();
+                    lock.lock();
+                }
+            } else if (watcherOpen) {
+                watcher.close();
+                watcherOpen = false;
+            }
+
+            int count = (int)spans.size();
+            int wanted = wantedStep;
+            if (wanted >= 0 && count > 0) {
+                // The playhead's page first, then the pages either side of it, wrapping around the file.
+                // The engine may still be counting steps against the file before a reload, so keep it in range.
+                int page = pageAt(std::min(wanted, rowCount - 1));
+                if (page < 0) page = 0;
+                int neighbours[3] = {page, (page + 1) % count, (page + count - 1) % count};
+                for (int neighbour : neighbours) {
+                    if (stopping) break;
+                    if (!isResident(neighbour)) {
+                        lock.unlock();
+                        compilePage(neighbour);
+                        lock.lock();
+                    }
+                }
+            }
+            // The engine doesn't notify, it just moves wantedStep, so check back every few milliseconds
+            wake.wait_for(lock, std::chrono::milliseconds(5));
+        }
+    }
+};
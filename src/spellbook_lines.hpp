@@ -0,0 +1,163 @@
+/*
+T's Musical Tools (TMT) - A collection of esoteric modules for VCV Rack, focused on manipulating RNG and polyphonic signals.
+Copyright (C) 2024  T
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+// A vector with a gap where it was last changed. Inserting or erasing moves the gap there first, which only
+// moves the items in between, so a run of edits in one spot costs next to nothing however long the vector is.
+template <typename T>
+struct SpellbookGapVector {
+    size_t size() const {
+        return items.size() - gapLength;
+    }
+
+    T& operator[](size_t index) {
+        return items[index < gapStart ? index : index + gapLength];
+    }
+
+    const T& operator[](size_t index) const {
+        return items[index < gapStart ? index : index + gapLength];
+    }
+
+    void assign(size_t count, const T& value) {
+        items.assign(count, value);
+        gapStart = count;
+        gapLength = 0;
+    }
+
+    void insert(size_t index, size_t count, const T& value) {
+        if (gapLength < count) {
+            grow(count);
+        }
+        moveGap(index);
+        std::fill(items.begin() + gapStart, items.begin() + gapStart + count, value);
+        gapStart += count;
+        gapLength -= count;
+    }
+
+    void erase(size_t index, size_t count) {
+        moveGap(index);
+        // Erased items are left in the gap, so let go of whatever they hold
+        std::fill(items.begin() + gapStart + gapLength, items.begin() + gapStart + gapLength + count, T());
+        gapLength += count;
+    }
+
+  private:
+    std::vector<T> items;
+    size_t gapStart = 0;
+    size_t gapLength = 0;
+
+    void moveGap(size_t index) {
+        if (gapLength == 0) {
+            // Nothing to move around, and moving items onto themselves would empty them
+        } else if (index < gapStart) {
+            std::move_backward(items.begin() + index, items.begin() + gapStart, items.begin() + gapStart + gapLength);
+        } else if (index > gapStart) {
+            std::move(items.begin() + gapStart + gapLength, items.begin() + index + gapLength, items.begin() + gapStart);
+        }
+        gapStart = index;
+    }
+
+    // Makes the gap big enough for count more, with room to spare so this is rare
+    void grow(size_t count) {
+        size_t extra = count + std::max<size_t>(16, size() / 4);
+        std::vector<T> bigger(items.size() + extra);
+        std::move(items.begin(), items.begin() + gapStart, bigger.begin());
+        std::move(items.begin() + gapStart + gapLength, items.end(), bigger.begin() + gapStart + gapLength + extra);
+        items.swap(bigger);
+        gapLength += extra;
+    }
+};
+
+// Where each line of a text starts, kept up to date edit by edit.
+// The starts sit in a gap vector, and an edit's change in length is only added to the lines after it
+// once another edit needs them to be right: until then, every start from stepLine on is stepLength short.
+// Moving that step costs as many lines as it moves, so typing in one place stays cheap at any length of text.
+struct SpellbookLineIndex {
+    int size() const {
+        return (int)starts.size();
+    }
+
+    int start(int line) const {
+        return starts[line] + (line >= stepLine ? stepLength : 0);
+    }
+
+    // Which line a position is on: the last one starting at or before it
+    int lineOf(int position) const {
+        int low = 0, high = size();
+        while (low < high) {
+            int middle = (low + high) / 2;
+            if (start(middle) <= position) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        return low - 1;
+    }
+
+    void assign(const std::vector<int>& lineStarts) {
+        starts.assign(lineStarts.size(), 0);
+        for (size_t line = 0; line < lineStarts.size(); line++) {
+            starts[line] = lineStarts[line];
+        }
+        stepLine = size();
+        stepLength = 0;
+    }
+
+    // Moves every line from line on along by delta
+    void shift(int line, int delta) {
+        moveStep(line);
+        stepLength += delta;
+    }
+
+    // Adds lines starting at the given positions before line
+    void insert(int line, const std::vector<int>& lineStarts) {
+        moveStep(line);
+        starts.insert(line, lineStarts.size(), 0);
+        for (size_t i = 0; i < lineStarts.size(); i++) {
+            starts[line + i] = lineStarts[i] - stepLength;
+        }
+    }
+
+    void erase(int line, int count) {
+        moveStep(line);
+        starts.erase(line, count);
+    }
+
+  private:
+    SpellbookGapVector<int> starts;
+    int stepLine = 0;
+    int stepLength = 0;
+
+    void moveStep(int line) {
+        if (stepLength == 0) {
+            stepLine = line;
+            return;
+        }
+        for (; stepLine < line; stepLine++) {
+            starts[stepLine] += stepLength;
+        }
+        for (; stepLine > line; stepLine--) {
+            starts[stepLine - 1] -= stepLength;
+        }
+    }
+};
@@ -0,0 +1,338 @@
+/*
+T's Musical Tools (TMT) - A collection of esoteric modules for VCV Rack, focused on manipulating RNG and polyphonic signals.
+Copyright (C) 2024  T
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// One written (non-empty) cell. Empty cells aren't stored at all, they just hold whatever the column had.
+struct CellEvent {
+    uint16_t column;
+    char type;        // 'N' for normal, 'T' for trigger, 'R' for retrigger, 'G' for gate
+    float voltage;
+    uint32_t text;    // Index into CompiledSequence::cellTexts, for ghost value display
+};
+
+// A distinct row: its written cells are events[firstEvent, firstEvent + eventCount), sorted by column.
+// Columns below width without an event are empty ('E'), columns past width are unused ('U').
+struct PoolRow {
+    uint32_t firstEvent;
+    uint16_t eventCount;
+    uint16_t width;
+};
+
+// A column's view of the sequence: which written row changes it, and to which event
+struct ColumnEvent {
+    uint32_t row;
+    uint32_t event;
+};
+
+// Everything Spellbook derives from a text when it parses it.
+// Once built it is never modified, so any number of Spellbooks holding the same text can share one copy,
+// and the UI can keep reading an old copy while the engine swaps in a new one.
+struct CompiledSequence {
+    uint64_t hash = 0;     // Content hash of the source text (see hashSequenceText())
+    std::string source;    // The text this was compiled from, to rule out hash collisions
+    std::vector<CellEvent> events;                      // Written cells of every pool row, back to back
+    std::vector<std::string> cellTexts;                 // Distinct cell texts, for ghosts
+    std::vector<PoolRow> rowPool;                       // Every distinct row, once
+    std::vector<uint32_t> rowIds;                       // Rows as written in the text -> row pool
+    std::vector<uint64_t> rowHashes;                    // Per pool row, a hash of its text, to recognize it in another compile
+    std::vector<uint32_t> order;                        // Arranged timeline: step -> written row
+    std::vector<uint32_t> rowLines;                     // Row -> text line it was written on
+    std::vector<int32_t> lineRows;                      // Text line -> row, or -1 for section and play order lines
+    std::vector<std::vector<ColumnEvent>> columns;      // Per column, the written rows that change it, in order
+    std::vector<size_t> ghostWidths;                    // Per column, the longest ghost it will ever show
+    std::vector<size_t> ghostOffsets;                   // Per column, the ghost widths of the columns before it added up
+    int columnCount = 0;   // Widest row
+    int widestRow = 0;     // Widest row within the first 16 columns, for POLY_WIDEST_ROW
+    int firstStep = 0;     // Where this starts in the timeline: 0 for a whole text, later for pages of a file
+
+    int stepCount() const {
+        return (int)order.size();
+    }
+
+    const PoolRow& stepRow(int step) const {
+        return rowPool[rowIds[order[step]]];
+    }
+
+    // Text line to highlight for a step of the arranged timeline, or -1
+    int stepLine(int step) const {
+        if (step < 0 || step >= (int)order.size()) return -1;
+        return rowLines[order[step]];
+    }
+
+    // Row written on a text line, or -1 if that line is a section header or play order
+    int lineRow(int line) const {
+        if (line < 0 || line >= (int)lineRows.size()) return -1;
+        return lineRows[line];
+    }
+
+    // Fills in ghostOffsets from ghostWidths: how far right ghosts push each column's text when shown
+    void sumGhostWidths() {
+        ghostOffsets.assign(ghostWidths.size(), 0);
+        size_t offset = 0;
+        for (size_t col = 0; col < ghostWidths.size(); col++) {
+            ghostOffsets[col] = offset;
+            offset += ghostWidths[col];
+        }
+    }
+
+    // What an event looks like as a ghost: its own text for values, 0 after gates and triggers
+    const std::string& ghostText(const CellEvent& event) const {
+        static const std::string zero = "0";
+        return event.type == 'N' ? cellTexts[event.text] : zero;
+    }
+
+    // Ghost text for a cell with nothing written in it: the last value written above it in the column,
+    // wrapping around to the end of the sequence. Empty if the cell has its own value.
+    std::string ghostAt(int row, int col) const {
+        if (col < 0 || col >= (int)columns.size() || columns[col].empty()) return "";
+        const std::vector<ColumnEvent>& column = columns[col];
+        auto it = std::lower_bound(column.begin(), column.end(), (uint32_t)row,
+            [](const ColumnEvent& e, uint32_t r) { return e.row < r; });
+        if (it != column.end() && it->row == (uint32_t)row) return "";
+        const ColumnEvent& previous = (it == column.begin()) ? column.back() : *(it - 1);
+        // Leading space for columns after the first, to line up with the space after the comma
+        return (col > 0 ? " " : "") + ghostText(events[previous.event]);
+    }
+};
+
+// Section headers (`@verse`) and play order lists (`> intro, verse*4, chorus`) are not rows
+inline bool isSequenceDirective(const std::string& line) {
+    size_t start = line.find_first_not_of(" \t\r");
+    return start != std::string::npos && (line[start] == '@' || line[start] == '>');
+}
+
+// 64-bit FNV-1a. Not cryptographic, just cheap and stable between sessions and platforms.
+inline uint64_t hashSequenceText(const std::string& text) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Binary form of a CompiledSequence, so a big sequence saved with the patch can skip parsing when it's loaded.
+// Everything but the source text, which is saved next to it anyway. Written and read on the same kind of machine
+// in practice, but the header records the layout it was written with, and anything that doesn't match is refused.
+#define SPELLBOOK_COMPILED_MAGIC 0x51534253u   // "SBSQ"
+#define SPELLBOOK_COMPILED_VERSION 2u
+
+struct CompiledSequenceHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t layout[4];    // sizeof CellEvent, PoolRow, ColumnEvent and size_t
+    uint64_t hash;
+    int32_t columnCount;
+    int32_t widestRow;
+};
+
+template <typename T>
+inline void writeCompiledVector(std::FILE* file, const std::vector<T>& values) {
+    uint64_t count = values.size();
+    std::fwrite(&count, sizeof(count), 1, file);
+    if (count > 0) std::fwrite(values.data(), sizeof(T), values.size(), file);
+}
+
+template <typename T>
+inline bool readCompiledVector(std::FILE* file, std::vector<T>& values) {
+    uint64_t count = 0;
+    if (std::fread(&count, sizeof(count), 1, file) != 1 || count > (1ULL << 32)) return false;
+    values.resize(count);
+    return count == 0 || std::fread(values.data(), sizeof(T), values.size(), file) == values.size();
+}
+
+inline void writeCompiledString(std::FILE* file, const std::string& value) {
+    uint64_t length = value.size();
+    std::fwrite(&length, sizeof(length), 1, file);
+    std::fwrite(value.data(), 1, value.size(), file);
+}
+
+inline bool readCompiledString(std::FILE* file, std::string& value) {
+    uint64_t length = 0;
+    if (std::fread(&length, sizeof(length), 1, file) != 1 || length > (1ULL << 32)) return false;
+    value.resize(length);
+    return length == 0 || std::fread(&value[0], 1, value.size(), file) == value.size();
+}
+
+inline bool writeCompiledSequence(const CompiledSequence& compiled, const std::string& path) {
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) return false;
+    CompiledSequenceHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.magic = SPELLBOOK_COMPILED_MAGIC;
+    header.version = SPELLBOOK_COMPILED_VERSION;
+    header.layout[0] = sizeof(CellEvent);
+    header.layout[1] = sizeof(PoolRow);
+    header.layout[2] = sizeof(ColumnEvent);
+    header.layout[3] = sizeof(size_t);
+    header.hash = compiled.hash;
+    header.columnCount = compiled.columnCount;
+    header.widestRow = compiled.widestRow;
+    std::fwrite(&header, sizeof(header), 1, file);
+
+    writeCompiledVector(file, compiled.events);
+    uint64_t textCount = compiled.cellTexts.size();
+    std::fwrite(&textCount, sizeof(textCount), 1, file);
+    for (const std::string& text : compiled.cellTexts) {
+        writeCompiledString(file, text);
+    }
+    writeCompiledVector(file, compiled.rowPool);
+    writeCompiledVector(file, compiled.rowIds);
+    writeCompiledVector(file, compiled.rowHashes);
+    writeCompiledVector(file, compiled.order);
+    writeCompiledVector(file, compiled.rowLines);
+    writeCompiledVector(file, compiled.lineRows);
+    uint64_t columnCount = compiled.columns.size();
+    std::fwrite(&columnCount, sizeof(columnCount), 1, file);
+    for (const std::vector<ColumnEvent>& column : compiled.columns) {
+        writeCompiledVector(file, column);
+    }
+    writeCompiledVector(file, compiled.ghostWidths);
+
+    bool written = !std::ferror(file);
+    return (std::fclose(file) == 0) && written;
+}
+
+// Returns null if the file is missing, damaged, from another layout, or for a different hash
+inline std::shared_ptr<CompiledSequence> readCompiledSequence(const std::string& path, uint64_t hash) {
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) return nullptr;
+    std::shared_ptr<CompiledSequence> compiled = std::make_shared<CompiledSequence>();
+    CompiledSequenceHeader header;
+    bool ok = std::fread(&header, sizeof(header), 1, file) == 1
+        && header.magic == SPELLBOOK_COMPILED_MAGIC
+        && header.version == SPELLBOOK_COMPILED_VERSION
+        && header.layout[0] == sizeof(CellEvent)
+        && header.layout[1] == sizeof(PoolRow)
+        && header.layout[2] == sizeof(ColumnEvent)
+        && header.layout[3] == sizeof(size_t)
+        && header.hash == hash;
+    if (ok) {
+        compiled->hash = header.hash;
+        compiled->columnCount = header.columnCount;
+        compiled->widestRow = header.widestRow;
+        ok = readCompiledVector(file, compiled->events);
+    }
+    uint64_t count = 0;
+    if (ok) {
+        ok = std::fread(&count, sizeof(count), 1, file) == 1 && count <= (1ULL << 32);
+        for (uint64_t i = 0; ok && i < count; i++) {
+            compiled->cellTexts.push_back(std::string());
+            ok = readCompiledString(file, compiled->cellTexts.back());
+        }
+    }
+    ok = ok && readCompiledVector(file, compiled->rowPool)
+        && readCompiledVector(file, compiled->rowIds)
+        && readCompiledVector(file, compiled->rowHashes)
+        && readCompiledVector(file, compiled->order)
+        && readCompiledVector(file, compiled->rowLines)
+        && readCompiledVector(file, compiled->lineRows);
+    if (ok) {
+        ok = std::fread(&count, sizeof(count), 1, file) == 1 && count <= (1ULL << 16);
+        compiled->columns.resize(ok ? count : 0);
+        for (uint64_t i = 0; ok && i < count; i++) {
+            ok = readCompiledVector(file, compiled->columns[i]);
+        }
+    }
+    ok = ok && readCompiledVector(file, compiled->ghostWidths);
+    std::fclose(file);
+    if (!ok) return nullptr;
+
+    // Cheap sanity checks, so a damaged file can't send playback out of bounds
+    if (compiled->order.empty() || compiled->rowIds.size() != compiled->rowLines.size()) return nullptr;
+    if (compiled->rowHashes.size() != compiled->rowPool.size()) return nullptr;
+    for (uint32_t row : compiled->order) {
+        if (row >= compiled->rowIds.size()) return nullptr;
+    }
+    for (uint32_t id : compiled->rowIds) {
+        if (id >= compiled->rowPool.size()) return nullptr;
+    }
+    for (const PoolRow& row : compiled->rowPool) {
+        if ((uint64_t)row.firstEvent + row.eventCount > compiled->events.size()) return nullptr;
+    }
+    for (const CellEvent& event : compiled->events) {
+        if (event.type == 'N' && event.text >= compiled->cellTexts.size()) return nullptr;
+    }
+    for (int32_t row : compiled->lineRows) {
+        if (row >= (int32_t)compiled->rowIds.size()) return nullptr;
+    }
+    if ((int)compiled->columns.size() != compiled->columnCount || compiled->ghostWidths.size() != compiled->columns.size()) return nullptr;
+    for (const std::vector<ColumnEvent>& column : compiled->columns) {
+        for (const ColumnEvent& entry : column) {
+            if (entry.event >= compiled->events.size()) return nullptr;
+        }
+    }
+    compiled->sumGhostWidths();
+    return compiled;
+}
+
+// Plugin-wide table of compiled sequences, keyed by the hash of their text.
+// The cache only holds weak references: a compiled sequence lives as long as some Spellbook uses it.
+struct SpellbookSequenceCache {
+    std::mutex mutex;
+    std::unordered_multimap<uint64_t, std::weak_ptr<const CompiledSequence>> entries;
+
+    static SpellbookSequenceCache& instance() {
+        static SpellbookSequenceCache cache;
+        return cache;
+    }
+
+    std::shared_ptr<const CompiledSequence> find(uint64_t hash, const std::string& text) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto range = entries.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            std::shared_ptr<const CompiledSequence> sequence = it->second.lock();
+            if (sequence && sequence->source == text) {
+                return sequence;
+            }
+        }
+        return nullptr;
+    }
+
+    // Publish a freshly compiled sequence. If another Spellbook beat us to the same text, share theirs instead.
+    std::shared_ptr<const CompiledSequence> insert(std::shared_ptr<const CompiledSequence> sequence) {
+        std::lock_guard<std::mutex> lock(mutex);
+        // Sweep out sequences nobody uses anymore while we're here
+        for (auto it = entries.begin(); it != entries.end();) {
+            if (it->second.expired()) {
+                it = entries.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        auto range = entries.equal_range(sequence->hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            std::shared_ptr<const CompiledSequence> existing = it->second.lock();
+            if (existing && existing->source == sequence->source) {
+                return existing;
+            }
+        }
+        entries.insert(std::make_pair(sequence->hash, std::weak_ptr<const CompiledSequence>(sequence)));
+        return sequence;
+    }
+};